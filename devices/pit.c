@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,55 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts CHANNEL counting down once from COUNT, which must be
+   between 1 and 65536 PIT cycles, in mode 0 ("interrupt on
+   terminal count").  The channel's output goes low now and rises
+   when the count reaches zero, so channel 0 raises a single timer
+   interrupt COUNT cycles from now.  The counter then keeps
+   running, but produces no further interrupts until the channel
+   is reprogrammed. */
+void
+pit_start_oneshot (int channel, unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count >= 1 && count <= 65536);
+
+  /* A count of 0 means 65536, so the truncation below is what
+     we want. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (0 << 1));
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current count of CHANNEL, that is, the number of
+   PIT cycles left before it reaches zero.  If OUTPUT is nonnull,
+   stores the state of the channel's output pin into *OUTPUT; in
+   mode 0 it is true once the count has run out.
+
+   Uses the 8254's read-back command, which latches the count and
+   the status together.  See [8254] "Read-Back Command". */
+unsigned
+pit_read_counter (int channel, bool *output)
+{
+  enum intr_level old_level;
+  uint8_t status;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  if (output != NULL)
+    *output = (status & 0x80) != 0;
+  return count != 0 ? count : 65536;
+}
@@ -1,5 +1,7 @@
 #include "devices/rtc.h"
+#include <debug.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/io.h"
 
 /* This code is an interface to the MC146818A-compatible real
@@ -28,14 +30,21 @@
 
 /* Register A. */
 #define RTCSA_UIP	0x80	/* Set while time update in progress. */
+#define RTCSA_RATE	0x0f	/* Periodic interrupt rate selector. */
 
 /* Register B. */
 #define	RTCSB_SET	0x80	/* Disables update to let time be set. */
+#define RTCSB_PIE	0x40	/* Enables the periodic interrupt. */
 #define RTCSB_DM	0x04	/* 0 = BCD time format, 1 = binary format. */
 #define RTCSB_24HR	0x02    /* 0 = 12-hour format, 1 = 24-hour format. */
 
+/* Callback for the periodic interrupt. */
+static intr_handler_func *periodic_handler;
+
 static int bcd_to_bin (uint8_t);
 static uint8_t cmos_read (uint8_t index);
+static void cmos_write (uint8_t index, uint8_t data);
+static void rtc_interrupt (struct intr_frame *);
 
 /* Returns number of seconds since Unix epoch of January 1,
    1970. */
@@ -95,6 +104,49 @@ rtc_get_time (void)
   return time;
 }
 
+/* Starts the RTC's periodic interrupt at HZ, rounded down to a
+   power of 2 between 2 and 8192 Hz, and arranges for HANDLER to
+   be called from each interrupt.  Returns the actual rate.
+
+   The periodic interrupt runs independently of the PIT, so it
+   can sample at a higher rate than the timer tick, at the cost
+   of an extra interrupt on every period. */
+int
+rtc_periodic_start (int hz, intr_handler_func *handler)
+{
+  enum intr_level old_level;
+  int rate;
+
+  ASSERT (hz > 0);
+  ASSERT (handler != NULL);
+
+  /* The rate selector R divides the 32768 Hz time base by
+     2**(R - 1).  Selectors 1 and 2 do not yield 16384 and
+     8192 Hz as one would expect, so use 3 through 15. */
+  for (rate = 3; rate < 15 && (32768 >> (rate - 1)) > hz; rate++)
+    continue;
+
+  old_level = intr_disable ();
+  periodic_handler = handler;
+  intr_register_ext (0x28, rtc_interrupt, "RTC");
+  cmos_write (RTC_REG_A, (cmos_read (RTC_REG_A) & ~RTCSA_RATE) | rate);
+  cmos_write (RTC_REG_B, cmos_read (RTC_REG_B) | RTCSB_PIE);
+  cmos_read (RTC_REG_C);
+  intr_set_level (old_level);
+
+  return 32768 >> (rate - 1);
+}
+
+/* RTC interrupt handler. */
+static void
+rtc_interrupt (struct intr_frame *f)
+{
+  /* Reading register C acknowledges the interrupt.  Until then
+     the RTC raises no further interrupts. */
+  cmos_read (RTC_REG_C);
+  periodic_handler (f);
+}
+
 /* Returns the integer value of the given BCD byte. */
 static int
 bcd_to_bin (uint8_t x)
@@ -110,3 +162,11 @@ cmos_read (uint8_t index)
   outb (CMOS_REG_SET, index);
   return inb (CMOS_REG_IO);
 }
+
+/* Writes DATA to the CMOS register with the given INDEX. */
+static void
+cmos_write (uint8_t index, uint8_t data)
+{
+  outb (CMOS_REG_SET, index);
+  outb (CMOS_REG_IO, data);
+}
@@ -5,12 +5,19 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/lockstat.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
+#include "threads/trace.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -127,12 +134,21 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  work_queue_print_stats ();
+  kmem_cache_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  cache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef LOCKSTAT
+  lockstat_print_stats ();
+#endif
+  profile_print_stats ();
+  trace_dump ();
 }
@@ -1,10 +1,12 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -20,11 +22,80 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* List of threads sleeping in timer_sleep(), ordered by
+   ascending wakeup tick so that timer_interrupt() only has to
+   look at the front of the list. */
+static struct list sleep_list;
+
+/* Hierarchical timing wheel for timer events.
+
+   Level L has WHEEL_SLOTS slots, each covering WHEEL_SLOTS**L
+   ticks, so the wheel as a whole spans WHEEL_SLOTS**WHEEL_LEVELS
+   ticks (about 46 hours at 100 Hz).  An event goes into the
+   lowest level whose span covers its distance from wheel_tick.
+   Whenever the level-0 index wraps around, the next slot of
+   level 1 is "cascaded": its events are re-added, which moves
+   them one level down; level 1 wrapping cascades level 2, and so
+   on.  Events further away than the wheel span are parked in the
+   top level and simply re-parked when their slot cascades. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Next tick whose level-0 slot the wheel has yet to expire.
+   Always equal to ticks + 1 outside the timer interrupt. */
+static int64_t wheel_tick;
+
+/* Tickless idle.
+
+   While a CPU idles, nothing needs a timer interrupt until the
+   next sleeper wakes up or the next timer event fires, so
+   timer_idle_enter() switches the PIT from periodic mode to a
+   single interrupt at the end of that tick.  The interrupt
+   handler then catches up on the skipped ticks, in order, and
+   goes back to periodic mode.  The 8254's 16-bit counter limits
+   one such interval to about 55 ms, i.e. 5 ticks at 100 Hz.
+
+   Any other interrupt that arrives first brings `ticks' up to
+   date and cuts the one-shot short at the end of the current
+   tick (see timer_idle_exit()), so that its handler, and any
+   thread it wakes, see the right time and are preempted as
+   usual.
+
+   Disabled by the kernel command-line option "-notickless". */
+bool timer_tickless = true;
+
+/* PIT cycles per timer tick, as pit_configure_channel() rounds
+   it, and the longest count the PIT can be loaded with. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define ONESHOT_MAX 65536
+
+static int64_t oneshot_ticks;   /* Ticks the one-shot covers, 0 if periodic. */
+static unsigned oneshot_base;   /* Cycles into the tick when loaded. */
+static unsigned oneshot_count;  /* Cycles the PIT was loaded with. */
+
+/* Number of timer interrupts taken, which tickless idle keeps
+   below the number of ticks. */
+static int64_t interrupt_cnt;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void clock_tick (void);
+static int64_t ticks_to_deadline (int64_t max);
+static void oneshot_start (int64_t n, unsigned elapsed);
+static unsigned oneshot_elapsed (bool *expired);
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static void event_schedule (struct timer_event *, int64_t ticks,
+                            int64_t period);
+static void wheel_init (void);
+static void wheel_insert (struct timer_event *);
+static void wheel_advance (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +107,8 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleep_list);
+  wheel_init ();
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -85,15 +158,26 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The current thread is blocked and queued on sleep_list until
+   timer_interrupt() finds that its wakeup tick has arrived, so
+   a sleeping thread costs nothing while it sleeps. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -163,17 +247,386 @@ timer_ndelay (int64_t ns)
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %"PRId64" interrupts\n",
+          timer_ticks (), interrupt_cnt);
 }
 
-/* Timer interrupt handler. */
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If nothing is due at the next tick, programs
+   the PIT to skip ahead to the first tick at which a sleeper
+   wakes or a timer event fires. */
+void
+timer_idle_enter (void)
+{
+  unsigned left, elapsed;
+  int64_t n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  /* In mode 2 the counter runs from TICK_CYCLES down to 1, then
+     raises the interrupt and reloads. */
+  left = pit_read_counter (0, NULL);
+  elapsed = left < TICK_CYCLES ? TICK_CYCLES - left : 0;
+  n = ticks_to_deadline ((ONESHOT_MAX + elapsed) / TICK_CYCLES);
+  if (n <= 1)
+    return;
+
+  oneshot_start (n, elapsed);
+
+  /* If a periodic tick slipped in while we were reprogramming,
+     it is still pending and would be taken for the end of the
+     one-shot.  Back out and let it count as the single tick it
+     is. */
+  if (intr_ext_pending (0x20))
+    {
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+}
+
+/* Called for each external interrupt other than the timer's.
+   If the PIT is running a one-shot started by timer_idle_enter(),
+   processes the ticks that have fully elapsed and cuts the
+   one-shot short at the end of the current tick, after which
+   the timer interrupt handler restores periodic mode. */
+void
+timer_idle_exit (void)
+{
+  unsigned elapsed;
+  int64_t whole;
+  bool expired;
+
+  ASSERT (intr_context ());
+
+  if (oneshot_ticks == 0)
+    return;
+
+  elapsed = oneshot_elapsed (&expired);
+  if (expired)
+    {
+      /* The timer interrupt is pending and will catch up. */
+      return;
+    }
+
+  whole = elapsed / TICK_CYCLES;
+  if (whole >= oneshot_ticks)
+    whole = oneshot_ticks - 1;
+  oneshot_ticks = 0;
+  while (whole-- > 0)
+    clock_tick ();
+  oneshot_start (1, elapsed % TICK_CYCLES);
+}
+
+/* Timer interrupt handler.  Normally accounts for one tick; at
+   the end of a tickless interval, for all the ticks it covered. */
+static void
+timer_interrupt (struct intr_frame *args)
+{
+  int64_t n = 1;
+
+  interrupt_cnt++;
+  if (profile_on_tick)
+    profile_sample (args);
+  if (oneshot_ticks != 0)
+    {
+      n = oneshot_ticks;
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+
+  while (n-- > 0)
+    clock_tick ();
+}
+
+/* Advances the clock by one tick and does that tick's work. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+clock_tick (void)
 {
   ticks++;
+
+  /* Wake up every sleeper whose time has come.  The list is
+     sorted, so we stop at the first thread that is not due. */
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
+
+  wheel_advance ();
   thread_tick ();
 }
 
+/* Returns the number of ticks until the next one at which a
+   sleeper wakes up or a timer event may fire, or MAX if that is
+   further away.  Interrupts must be off. */
+static int64_t
+ticks_to_deadline (int64_t max)
+{
+  int64_t n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick - ticks < max)
+        max = t->wakeup_tick - ticks;
+    }
+
+  /* Level-0 slots within WHEEL_SLOTS ticks hold exactly the
+     events due at their tick.  A tick at which level 0 wraps
+     around may cascade events down that are due immediately, so
+     treat it as a deadline too. */
+  for (n = 1; n < max; n++)
+    {
+      int64_t when = ticks + n;
+      if ((when & WHEEL_MASK) == 0
+          || !list_empty (&wheel[0][when & WHEEL_MASK]))
+        break;
+    }
+  return n;
+}
+
+/* Loads the PIT with a one-shot count that ends tick ticks + N,
+   given that ELAPSED cycles of tick ticks + 1 have already gone
+   by. */
+static void
+oneshot_start (int64_t n, unsigned elapsed)
+{
+  ASSERT (n * TICK_CYCLES > elapsed);
+  ASSERT (n * TICK_CYCLES - elapsed <= ONESHOT_MAX);
+
+  oneshot_ticks = n;
+  oneshot_base = elapsed;
+  oneshot_count = n * TICK_CYCLES - elapsed;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* Returns the number of cycles of tick ticks + 1 gone by since
+   the current one-shot was set up, and stores into *EXPIRED
+   whether the one-shot has run out. */
+static unsigned
+oneshot_elapsed (bool *expired)
+{
+  unsigned left = pit_read_counter (0, expired);
+
+  /* Right after loading, the counter may not have picked up
+     the new count yet. */
+  if (left > oneshot_count)
+    left = oneshot_count;
+  return oneshot_base + (oneshot_count - left);
+}
+
+/* Returns true if sleeping thread A wakes up before B.  Threads
+   with equal wakeup ticks keep their insertion order. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Initializes timer event EV to invoke FUNC with AUX when it
+   expires.  The event is not scheduled until added. */
+void
+timer_event_init (struct timer_event *ev, timer_event_func *func, void *aux)
+{
+  ASSERT (ev != NULL);
+  ASSERT (func != NULL);
+
+  ev->expires = 0;
+  ev->period = 0;
+  ev->pending = false;
+  ev->func = func;
+  ev->aux = aux;
+}
+
+/* Schedules EV to fire once, TICKS timer ticks from now.  If EV
+   is already pending it is rescheduled.  A nonpositive TICKS
+   fires at the next timer tick.
+
+   This function may be called from an interrupt handler,
+   including from a timer event callback. */
+void
+timer_event_add (struct timer_event *ev, int64_t ticks)
+{
+  event_schedule (ev, ticks, 0);
+}
+
+/* Schedules EV to fire every PERIOD timer ticks, starting PERIOD
+   ticks from now, until it is cancelled.  If EV is already
+   pending it is rescheduled. */
+void
+timer_event_add_periodic (struct timer_event *ev, int64_t period)
+{
+  ASSERT (period > 0);
+
+  event_schedule (ev, period, period);
+}
+
+/* Cancels EV.  Returns true if EV was pending, false if it had
+   already fired (for a one-shot event) or was never added.
+   After this returns, EV's callback will not be invoked again,
+   so the caller may reuse or free EV. */
+bool
+timer_event_cancel (struct timer_event *ev)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  was_pending = ev->pending;
+  if (was_pending)
+    {
+      list_remove (&ev->elem);
+      ev->pending = false;
+    }
+  ev->period = 0;
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Returns true if EV is scheduled to fire. */
+bool
+timer_event_pending (const struct timer_event *ev)
+{
+  ASSERT (ev != NULL);
+
+  return ev->pending;
+}
+
+/* Queues EV to fire TICKS ticks from now and then, if PERIOD is
+   nonzero, every PERIOD ticks after that. */
+static void
+event_schedule (struct timer_event *ev, int64_t ticks, int64_t period)
+{
+  enum intr_level old_level;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  if (ev->pending)
+    list_remove (&ev->elem);
+  ev->period = period;
+  ev->expires = wheel_tick + (ticks > 0 ? ticks - 1 : 0);
+  wheel_insert (ev);
+  intr_set_level (old_level);
+}
+
+/* Initializes the timing wheel. */
+static void
+wheel_init (void)
+{
+  int level, slot;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
+  wheel_tick = ticks + 1;
+}
+
+/* Puts EV into the wheel slot that corresponds to its expiration
+   tick, relative to wheel_tick.  Interrupts must be off. */
+static void
+wheel_insert (struct timer_event *ev)
+{
+  int64_t delta = ev->expires - wheel_tick;
+  int64_t when = ev->expires;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0)
+    {
+      /* Already overdue: expire at the next wheel tick. */
+      when = wheel_tick;
+      delta = 0;
+    }
+  else if (delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+    {
+      /* Beyond the wheel's span: park it in the farthest slot
+         of the top level.  It gets re-parked when it cascades. */
+      when = wheel_tick + ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+      delta = when - wheel_tick;
+    }
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+
+  list_push_back (&wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK],
+                  &ev->elem);
+  ev->pending = true;
+}
+
+/* Re-adds every event in slot SLOT of wheel level LEVEL, which
+   moves each of them down to a lower level.  Returns SLOT, so
+   that the caller can tell whether the level wrapped around. */
+static int
+wheel_cascade (int level, int slot)
+{
+  struct list *bucket = &wheel[level][slot];
+
+  while (!list_empty (bucket))
+    wheel_insert (list_entry (list_pop_front (bucket),
+                              struct timer_event, elem));
+  return slot;
+}
+
+/* Expires every timer event due at or before the current tick.
+   Called from the timer interrupt. */
+static void
+wheel_advance (void)
+{
+  while (wheel_tick <= ticks)
+    {
+      int64_t now = wheel_tick;
+      int index = now & WHEEL_MASK;
+      struct list expired;
+      int level;
+
+      /* Pull the next slot of each higher level down once the
+         level below it wraps around. */
+      for (level = 1; index == 0 && level < WHEEL_LEVELS; level++)
+        index = wheel_cascade (level,
+                               (now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+      /* Detach the due slot before running callbacks, because a
+         callback may re-add its own or other events. */
+      list_init (&expired);
+      wheel_tick++;
+      while (!list_empty (&wheel[0][now & WHEEL_MASK]))
+        list_push_back (&expired, list_pop_front (&wheel[0][now & WHEEL_MASK]));
+
+      while (!list_empty (&expired))
+        {
+          struct timer_event *ev = list_entry (list_pop_front (&expired),
+                                               struct timer_event, elem);
+          ev->pending = false;
+          if (ev->period > 0)
+            {
+              ev->expires += ev->period;
+              wheel_insert (ev);
+            }
+          ev->func (ev, ev->aux);
+        }
+    }
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
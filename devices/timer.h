@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -26,4 +28,39 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* Kernel timers.
+
+   A timer event runs a callback once its expiration tick
+   arrives, either once or repeatedly every PERIOD ticks.  Events
+   live in a hierarchical timing wheel driven by the timer
+   interrupt, so adding, cancelling and expiring an event are all
+   constant time regardless of how many events are pending.
+
+   Callbacks run in the timer interrupt handler, with interrupts
+   off, so they must not sleep.  A typical callback unblocks a
+   thread or ups a semaphore. */
+struct timer_event;
+typedef void timer_event_func (struct timer_event *, void *aux);
+
+struct timer_event
+  {
+    struct list_elem elem;      /* Element in a timing wheel slot. */
+    int64_t expires;            /* Tick at which the event fires. */
+    int64_t period;             /* Reload interval, or 0 if one-shot. */
+    bool pending;               /* True while queued in the wheel. */
+    timer_event_func *func;     /* Callback. */
+    void *aux;                  /* Callback argument. */
+  };
+
+void timer_event_init (struct timer_event *, timer_event_func *, void *aux);
+void timer_event_add (struct timer_event *, int64_t ticks);
+void timer_event_add_periodic (struct timer_event *, int64_t period);
+bool timer_event_cancel (struct timer_event *);
+bool timer_event_pending (const struct timer_event *);
+
 #endif /* devices/timer.h */
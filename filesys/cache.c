@@ -0,0 +1,397 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+
+/* How often dirty sectors are written back, in timer ticks. */
+#define CACHE_FLUSH_TICKS TIMER_FREQ
+
+/* Maximum number of read-ahead requests waiting to run.  More
+   are dropped. */
+#define READAHEAD_MAX 8
+
+/* A cached sector. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    block_sector_t sector;      /* Sector held, if VALID. */
+    bool valid;                 /* True if this entry holds a sector. */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pins;                   /* # of threads using or loading DATA. */
+
+    /* Protected by LOCK, which is held only by threads that have
+       pinned the entry, so an unpinned entry's lock is free. */
+    struct lock lock;           /* Serializes access to DATA. */
+    bool dirty;                 /* DATA differs from disk? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;      /* Protects the fields above. */
+static struct condition unpinned;   /* Signaled when a pin drops to 0. */
+static int clock_hand;              /* Next entry to consider evicting. */
+
+/* Sectors waiting to be read ahead, protected by cache_lock. */
+static block_sector_t readahead_queue[READAHEAD_MAX];
+static int readahead_cnt;
+
+/* Write-behind and read-ahead run in their own queue, so that
+   disk waits do not hold up the system queue. */
+static struct work_queue cache_wq;
+static struct work flush_work;
+static struct work readahead_work;
+
+/* Statistics. */
+static long long hit_cnt;           /* Accesses found in the cache. */
+static long long miss_cnt;          /* Accesses that read the disk. */
+static long long readahead_read_cnt; /* Sectors read ahead. */
+static long long writeback_cnt;     /* Dirty sectors written back. */
+
+static struct cache_entry *cache_get (block_sector_t, bool load,
+                                      bool readahead);
+static void cache_put (struct cache_entry *);
+static void flush_entry (struct cache_entry *);
+static void flush_work_func (struct work *, void *);
+static void readahead_work_func (struct work *, void *);
+
+/* Initializes the buffer cache and starts its write-behind and
+   read-ahead work.  Must be called after work_queue_init(). */
+void
+cache_init (void)
+{
+  uint8_t *pages;
+  int i;
+
+  pages = palloc_get_multiple (PAL_ASSERT,
+                               CACHE_SIZE * BLOCK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->valid = false;
+      e->accessed = false;
+      e->pins = 0;
+      lock_init (&e->lock);
+      e->dirty = false;
+      e->data = pages + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  cond_init (&unpinned);
+
+  work_queue_create (&cache_wq, "cache", 1, PRI_DEFAULT);
+  work_init (&readahead_work, readahead_work_func, NULL);
+  work_init (&flush_work, flush_work_func, NULL);
+  work_queue_submit_delayed (&cache_wq, &flush_work, CACHE_FLUSH_TICKS);
+}
+
+/* Reads SECTOR from the cache into BUFFER, which must have room
+   for BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR from the
+   cache into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true, false);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into SECTOR in the
+   cache. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR in the cache,
+   starting at offset OFS within the sector.  The rest of the
+   sector is read from disk first unless the write covers all of
+   it. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE, false);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   in anticipation of a read that is likely to follow.  Does
+   nothing if the read-ahead queue is full. */
+void
+cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (readahead_cnt < READAHEAD_MAX)
+    {
+      readahead_queue[readahead_cnt++] = sector;
+      work_queue_submit (&cache_wq, &readahead_work);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes SECTOR back to disk now if it is cached and dirty, for
+   callers that must have it on disk before they write a sector
+   that depends on it. */
+void
+cache_write_back (block_sector_t sector)
+{
+  int i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid || e->sector != sector)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pins++;
+      lock_release (&cache_lock);
+
+      /* E cannot be evicted while pinned, so it still holds
+         SECTOR once we have its lock. */
+      lock_acquire (&e->lock);
+      flush_entry (e);
+      cache_put (e);
+      return;
+    }
+}
+
+/* Writes every dirty cached sector back to disk. */
+void
+cache_flush (void)
+{
+  int i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid || !e->dirty)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pins++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      flush_entry (e);
+      cache_put (e);
+    }
+}
+
+/* Stops write-behind and writes every dirty sector back, for
+   shutdown. */
+void
+cache_done (void)
+{
+  work_cancel (&flush_work);
+  cache_flush ();
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  long long total = hit_cnt + miss_cnt;
+
+  printf ("Cache: %lld hits, %lld misses (%lld%% hit rate), "
+          "%lld read ahead, %lld written back\n",
+          hit_cnt, miss_cnt, total > 0 ? hit_cnt * 100 / total : 0,
+          readahead_read_cnt, writeback_cnt);
+}
+
+/* Returns an entry that may be reused, advancing the clock hand,
+   or a null pointer if every entry is pinned.  cache_lock must
+   be held. */
+static struct cache_entry *
+choose_victim (void)
+{
+  int i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (!e->valid)
+        return e;
+      else if (e->pins > 0)
+        continue;
+      else if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Returns SECTOR's entry, pinned and with its lock held,
+   bringing it into the cache if necessary.  Unless LOAD is
+   false, because the caller is about to overwrite the whole
+   sector, a newly cached sector is read from disk.
+
+   If READAHEAD is true, the access is a guess rather than a
+   demand: it is not counted as a hit or a miss, and if SECTOR is
+   already cached the function returns a null pointer. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load, bool readahead)
+{
+  struct cache_entry *e;
+  int i;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      for (i = 0; i < CACHE_SIZE; i++)
+        {
+          e = &cache[i];
+          if (e->valid && e->sector == sector)
+            break;
+        }
+      if (i < CACHE_SIZE)
+        {
+          /* Hit.  If the sector is still being loaded, waiting
+             for its lock waits for the load. */
+          if (readahead)
+            {
+              lock_release (&cache_lock);
+              return NULL;
+            }
+          e->pins++;
+          e->accessed = true;
+          hit_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      e = choose_victim ();
+      if (e == NULL)
+        {
+          cond_wait (&unpinned, &cache_lock);
+          continue;
+        }
+      if (e->valid && e->dirty)
+        {
+          /* Write the victim back while it still holds its old
+             sector, so that nobody reads the stale disk copy,
+             then look again: someone may have cached SECTOR or
+             used the victim in the meantime. */
+          e->pins++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          flush_entry (e);
+          cache_put (e);
+          lock_acquire (&cache_lock);
+          continue;
+        }
+      break;
+    }
+
+  /* Miss.  E is unpinned, so its lock is free. */
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  e->pins = 1;
+  if (readahead)
+    readahead_read_cnt++;
+  else
+    miss_cnt++;
+  lock_acquire (&e->lock);
+  lock_release (&cache_lock);
+
+  if (load)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  if (--e->pins == 0)
+    cond_broadcast (&unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Writes E back to disk if it is dirty.  E's lock must be
+   held. */
+static void
+flush_entry (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+      writeback_cnt++;
+    }
+}
+
+/* Periodically writes dirty sectors back to disk, so that a
+   crash loses at most CACHE_FLUSH_TICKS worth of writes. */
+static void
+flush_work_func (struct work *w, void *aux UNUSED)
+{
+  cache_flush ();
+  work_queue_submit_delayed (&cache_wq, w, CACHE_FLUSH_TICKS);
+}
+
+/* Reads the sectors in readahead_queue into the cache. */
+static void
+readahead_work_func (struct work *w UNUSED, void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+      block_sector_t sector;
+
+      lock_acquire (&cache_lock);
+      if (readahead_cnt == 0)
+        {
+          lock_release (&cache_lock);
+          break;
+        }
+      sector = readahead_queue[0];
+      memmove (readahead_queue, readahead_queue + 1,
+               --readahead_cnt * sizeof *readahead_queue);
+      lock_release (&cache_lock);
+
+      e = cache_get (sector, true, true);
+      if (e != NULL)
+        cache_put (e);
+    }
+}
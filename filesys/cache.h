@@ -0,0 +1,36 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+/* Buffer cache.
+
+   All file system access to fs_device goes through a cache of
+   CACHE_SIZE sectors, so that inodes, indirect blocks and
+   directory sectors that are used over and over are read from
+   disk only once.  Writes only mark the cached sector dirty; a
+   background flusher writes dirty sectors back every
+   CACHE_FLUSH_TICKS, eviction writes back the victim if it is
+   still dirty, and cache_flush() writes back everything.  None
+   of these write in any particular order; a caller that needs one
+   sector on disk before another uses cache_write_back().
+
+   Sectors are evicted in "clock" order, which approximates LRU:
+   a sector used since the clock hand last passed it gets a
+   second chance. */
+
+/* Number of sectors cached. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, int ofs, int size);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, int ofs, int size);
+void cache_readahead (block_sector_t);
+void cache_write_back (block_sector_t);
+void cache_flush (void);
+void cache_done (void);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
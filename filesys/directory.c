@@ -206,6 +206,11 @@ dir_remove (struct dir *dir, const char *name)
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
+  /* Put the erased entry on disk before the inode's sectors can
+     be released, so the disk never has an entry that points to
+     sectors the free map calls free. */
+  inode_write_back (dir->inode, ofs, sizeof e);
+
   /* Remove inode. */
   inode_remove (inode);
   success = true;
@@ -1,6 +1,7 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -8,6 +9,23 @@
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Changes to the free map are written to the free map file by
+   free_map_flush(), not as they are made, and only the sectors
+   of the file that changed are written.  Callers flush before
+   writing an inode that refers to newly allocated sectors, and
+   the flush writes the changed sectors through the buffer cache
+   to disk, so an allocation is on disk before any inode that
+   refers to it.  Releases happen only after dir_remove() has
+   written the erased directory entry to disk.  A crash can then
+   leak sectors but never hand them out again while they are in
+   use. */
+static struct bitmap *dirty_map;     /* Free map file sectors to write. */
+
+/* Number of free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+static void mark_dirty (block_sector_t sector, size_t cnt);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -17,36 +35,123 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                           BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.
+   The change reaches disk at the next free_map_flush(). */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
   block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates up to CNT consecutive sectors, as close after HINT
+   as possible, and stores the first into *SECTORP.  Returns the
+   number of sectors allocated, which is CNT if there is a free
+   run that long at or after HINT, otherwise the length of the
+   first free run found at or after HINT, wrapping around to the
+   start of the disk if necessary.  Returns 0 if the disk is
+   full.
+   The change reaches disk at the next free_map_flush(). */
+size_t
+free_map_allocate_extent (block_sector_t hint, size_t cnt,
+                          block_sector_t *sectorp)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start, end;
+
+  ASSERT (cnt > 0);
+
+  if (hint >= size)
+    hint = 0;
+  start = bitmap_scan (free_map, hint, cnt, false);
+  if (start == BITMAP_ERROR)
+    {
+      start = bitmap_scan (free_map, hint, 1, false);
+      if (start == BITMAP_ERROR)
+        start = bitmap_scan (free_map, 0, 1, false);
+      if (start == BITMAP_ERROR)
+        return 0;
+      for (end = start + 1; end < size && end - start < cnt; end++)
+        if (bitmap_test (free_map, end))
+          break;
+      cnt = end - start;
+    }
+  bitmap_set_multiple (free_map, start, cnt, true);
+  mark_dirty (start, cnt);
+  *sectorp = start;
+  return cnt;
+}
+
+/* Returns the first sector of the allocation group for the file
+   whose inode is in SECTOR.  Files are spread over the groups by
+   inode number, so that files growing at the same time do not
+   interleave their sectors. */
+block_sector_t
+free_map_group (block_sector_t sector)
+{
+  size_t group_cnt = DIV_ROUND_UP (bitmap_size (free_map),
+                                   FREE_MAP_GROUP_SECTORS);
+  return sector % group_cnt * FREE_MAP_GROUP_SECTORS;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.
+   The change reaches disk at the next free_map_flush(). */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+}
+
+/* Marks the free map file sectors that hold the bits for CNT
+   sectors starting at SECTOR as needing to be written. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first, last;
+
+  if (cnt == 0)
+    return;
+  first = sector / BITS_PER_SECTOR;
+  last = (sector + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Writes the sectors of the free map file that have changed
+   since they were last written, through to disk. */
+void
+free_map_flush (void)
+{
+  size_t i;
+
+  if (free_map_file == NULL)
+    return;
+  for (i = bitmap_scan (dirty_map, 0, 1, true); i != BITMAP_ERROR;
+       i = bitmap_scan (dirty_map, i + 1, 1, true))
+    {
+      if (!bitmap_write_at (free_map, free_map_file,
+                            i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        PANIC ("can't write free map");
+      inode_write_back (file_get_inode (free_map_file),
+                        i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      bitmap_reset (dirty_map, i);
+    }
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +163,16 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_map, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -82,4 +190,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
 }
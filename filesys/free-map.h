@@ -10,8 +10,15 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
+
+/* Number of sectors in an allocation group. */
+#define FREE_MAP_GROUP_SECTORS 1024
 
 bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_extent (block_sector_t hint, size_t cnt,
+                                 block_sector_t *);
+block_sector_t free_map_group (block_sector_t);
 void free_map_release (block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
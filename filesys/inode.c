@@ -2,25 +2,75 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 /* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
+#define INODE_MAGIC 0x494e4f44          /* Block map format. */
+#define INODE_EXTENT_MAGIC 0x494e4f45   /* Extent format. */
 #define NUM_OF_DIRECT_POINTER 120
 #define NUM_OF_INDIRECT_POINTER 4
 #define INDIRECT_POINTERS_PRE_SECTOR BLOCK_SECTOR_SIZE / sizeof(block_sector_t)  // should be 128
+#define NUM_OF_EXTENTS 41
+
+/* Largest file, in sectors and bytes: what a block map can address. */
+#define INODE_MAX_SECTORS (NUM_OF_DIRECT_POINTER \
+                           + NUM_OF_INDIRECT_POINTER * INDIRECT_POINTERS_PRE_SECTOR \
+                           + INDIRECT_POINTERS_PRE_SECTOR * INDIRECT_POINTERS_PRE_SECTOR)
+#define INODE_MAX_LENGTH ((off_t) (INODE_MAX_SECTORS * BLOCK_SECTOR_SIZE))
+
+/* Disk sector that stands for a hole, a part of a file that was
+   never written and reads as zeros.  No file data is ever stored
+   in sector 0, which holds the free map inode. */
+#define HOLE_SECTOR 0
+
+/* If false, writing past end of file leaves a hole between the
+   old end and the new data, allocated on first write.  If true,
+   every sector in between is allocated and zeroed at once. */
+bool inode_prealloc;
+
+/* A sector of zeros, for initializing newly allocated sectors. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* A run of file sectors stored in consecutive disk sectors. */
+struct inode_extent
+  {
+    block_sector_t logical;             /* First file sector in the run. */
+    block_sector_t start;               /* First disk sector in the run. */
+    block_sector_t length;              /* Number of sectors. */
+  };
 
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   New inodes record their data as a list of extents, so a file
+   laid out contiguously needs one entry however large it is.  An
+   inode that runs out of extents is converted to a block map of
+   direct, indirect and double indirect pointers, which is also
+   the format of inodes written before extents existed. */
 struct inode_disk
   {
-    block_sector_t direct_pointer[NUM_OF_DIRECT_POINTER];   // each pointer points to one sector of file data
-    block_sector_t indirect_pointer[NUM_OF_INDIRECT_POINTER];
-    block_sector_t double_indirect_pointer;
+    union
+      {
+        struct                          /* If MAGIC is INODE_MAGIC. */
+          {
+            block_sector_t direct_pointer[NUM_OF_DIRECT_POINTER];   // each pointer points to one sector of file data
+            block_sector_t indirect_pointer[NUM_OF_INDIRECT_POINTER];
+            block_sector_t double_indirect_pointer;
+          };
+        struct                          /* If MAGIC is INODE_EXTENT_MAGIC. */
+          {
+            struct inode_extent extents[NUM_OF_EXTENTS];  // in file order
+            uint32_t extent_cnt;
+            uint32_t unused;
+          };
+      };
 
     off_t length;                       /* File size in bytes. include the last byte for EOF*/
     bool is_dir;                    /* True if inode is a directory */
@@ -39,6 +89,13 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Returns true if INODED is in extent format. */
+static inline bool
+is_extent_inode (const struct inode_disk *inoded)
+{
+  return inoded->magic == INODE_EXTENT_MAGIC;
+}
+
 /* In-memory inode. */
 struct inode
   {
@@ -49,27 +106,50 @@ struct inode
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
     struct lock lock_inode;
+
+    /* Indirect blocks already read by byte_to_sector(), or null
+       pointers.  Only the most recently used second-level block
+       of the double indirect tree is kept, since sequential
+       access uses each one for 128 sectors in a row.  Protected
+       by lock_inode. */
+    struct inode_indirect_pointer *indirect[NUM_OF_INDIRECT_POINTER];
+    struct inode_indirect_pointer *double_indirect;
+    struct inode_indirect_pointer *level2;
+    off_t level2_idx;                   /* Index of LEVEL2 in DOUBLE_INDIRECT. */
   };
 
-static bool inode_allocate(struct inode_disk *inoded, off_t length);
+static bool inode_allocate(struct inode_disk *inoded, block_sector_t sector, off_t length, off_t write_ofs);
+static bool inode_add_run(struct inode_disk *inoded, size_t idx, block_sector_t start, size_t cnt, block_sector_t *hint);
 static void inode_deallocate(struct inode_disk *inoded);
 
 
-static block_sector_t _byte_to_sector(const struct inode_disk * inoded, off_t sector_idx);
+static block_sector_t _byte_to_sector(struct inode *inode, off_t sector_idx);
+static block_sector_t extent_lookup (const struct inode_disk *inoded, off_t sector_idx);
+static void inode_map_invalidate (struct inode *inode);
+
+/* Returns the disk sector that holds file sector SECTOR_IDX of
+   INODE, or HOLE_SECTOR.  INODE's lock must be held. */
+static block_sector_t
+sector_lookup (struct inode *inode, off_t sector_idx)
+{
+  if (is_extent_inode (&inode->data))
+    return extent_lookup (&inode->data, sector_idx);
+  return _byte_to_sector (inode, sector_idx);
+}
 
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, or HOLE_SECTOR if POS is in a hole. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+byte_to_sector (struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   bool lock_held = lock_held_by_current_thread (&inode->lock_inode);
   if (!lock_held) lock_acquire(&inode->lock_inode);
   block_sector_t ret;
   if (pos < inode->data.length) { // < because last byte is terminator
-     ret = _byte_to_sector(&inode->data, pos/BLOCK_SECTOR_SIZE);
+     ret = sector_lookup (inode, pos/BLOCK_SECTOR_SIZE);
  }
   else ret = -1;
 
@@ -77,11 +157,53 @@ byte_to_sector (const struct inode *inode, off_t pos)
   return ret;
 }
 
+/* Returns the disk sector that holds file sector SECTOR_IDX of
+   extent-format INODED, or HOLE_SECTOR if no extent covers it. */
+static block_sector_t
+extent_lookup (const struct inode_disk *inoded, off_t sector_idx)
+{
+   uint32_t i;
+
+   for (i = 0; i < inoded->extent_cnt; i++) {
+      const struct inode_extent *e = &inoded->extents[i];
+      if ((block_sector_t) sector_idx - e->logical < e->length)
+         return e->start + (sector_idx - e->logical);
+   }
+   return HOLE_SECTOR;
+}
+
+/* Returns pointer IDX from the indirect block in SECTOR.  *BLOCK
+   caches the block: it is read on first use and kept for later
+   lookups.  If there is no memory to keep it, just the pointer
+   is read.  A hole in place of the indirect block maps only
+   holes. */
+static block_sector_t
+indirect_lookup (struct inode_indirect_pointer **block,
+                 block_sector_t sector, off_t idx)
+{
+   block_sector_t ret;
+
+   if (sector == HOLE_SECTOR)
+      return HOLE_SECTOR;
+
+   if (*block == NULL) {
+      *block = malloc (sizeof **block);
+      if (*block == NULL) {
+         cache_read_at (sector, &ret, idx * sizeof ret, sizeof ret);
+         return ret;
+      }
+      cache_read (sector, *block);
+   }
+   return (*block)->sector_ptr[idx];
+}
+
 /**
    sector_idx: the offset from the start of the inode data in unit of sector
-   Assumes sector_idx is within the allocated data sectors of the file (checked in byte_to_sector)
+   Assumes sector_idx is within the file (checked in byte_to_sector); returns HOLE_SECTOR if it was never written
+   Indirect blocks are cached in INODE, so a lookup in a hot file reads no sectors.
 */
-static block_sector_t _byte_to_sector(const struct inode_disk * inoded, off_t sector_idx) {
+static block_sector_t _byte_to_sector(struct inode *inode, off_t sector_idx) {
+   const struct inode_disk *inoded = &inode->data;
    off_t sector_limit = NUM_OF_DIRECT_POINTER * 1;   // the maximum number of sectors can be used for file; starting with the number of direct pointers, will grow
    // times 1 is just an indication that each pointer points to 1 sector
    off_t cur_base = 0;
@@ -93,12 +215,9 @@ static block_sector_t _byte_to_sector(const struct inode_disk * inoded, off_t se
    for (int i=0; i<NUM_OF_INDIRECT_POINTER; i++) {
       sector_limit += INDIRECT_POINTERS_PRE_SECTOR * 1;  // each indirect pointer creates INDIRECT_POINTERS_PRE_SECTOR number of sectors available for file data
       if (sector_idx < sector_limit) {
-         struct inode_indirect_pointer *indptr = malloc(sizeof(struct inode_indirect_pointer));
-         block_read (fs_device, inoded->indirect_pointer[i], indptr);
          off_t indirect_offset = sector_idx - cur_base;  // the nth pointer in the region pointed by this indirect pointer
-         block_sector_t ret = indptr->sector_ptr[indirect_offset]; // returned is the sector num of the file data sector
-         free(indptr);
-         return ret;
+         return indirect_lookup (&inode->indirect[i], inoded->indirect_pointer[i],
+                                 indirect_offset);  // the sector num of the file data sector
       }
       cur_base = sector_limit;
    }
@@ -106,16 +225,18 @@ static block_sector_t _byte_to_sector(const struct inode_disk * inoded, off_t se
    // now move on to double indirect pointer
    sector_limit += INDIRECT_POINTERS_PRE_SECTOR * 1 * INDIRECT_POINTERS_PRE_SECTOR * 1;
    if (sector_idx < sector_limit) {
-      struct inode_indirect_pointer *level1ptr = malloc(sizeof(struct inode_indirect_pointer));
-      struct inode_indirect_pointer *level2ptr = malloc(sizeof(struct inode_indirect_pointer));
-      block_read (fs_device, inoded->double_indirect_pointer, level1ptr);
       off_t first_level_off = (sector_idx - cur_base) / INDIRECT_POINTERS_PRE_SECTOR;
-      block_read (fs_device, level1ptr->sector_ptr[first_level_off], level2ptr);
       off_t second_level_off = (sector_idx - cur_base) % INDIRECT_POINTERS_PRE_SECTOR;
-      block_sector_t ret = level2ptr->sector_ptr[second_level_off];
-      free(level1ptr);
-      free(level2ptr);
-      return ret;
+      block_sector_t level2_sector = indirect_lookup (&inode->double_indirect,
+                                                      inoded->double_indirect_pointer,
+                                                      first_level_off);
+      if (inode->level2 != NULL && inode->level2_idx != first_level_off) {
+         // switch to another second-level block
+         free (inode->level2);
+         inode->level2 = NULL;
+      }
+      inode->level2_idx = first_level_off;
+      return indirect_lookup (&inode->level2, level2_sector, second_level_off);
    }
 
    NOT_REACHED ();
@@ -129,11 +250,74 @@ static block_sector_t _byte_to_sector(const struct inode_disk * inoded, off_t se
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes.  Lookups, the common case, share it. */
+static struct rwlock open_inodes_lock;
+
+/* Allocates struct inode, which is too big for malloc() to store
+   without waste. */
+static struct kmem_cache inode_cache;
+
+static void inode_ctor (void *);
+
+static struct inode *open_inodes_find (block_sector_t sector);
+
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
   list_init (&open_inodes);
+  rwlock_init (&open_inodes_lock);
+  kmem_cache_create (&inode_cache, "inode", sizeof (struct inode),
+                     inode_ctor);
+}
+
+/* Constructor for inode_cache. */
+static void
+inode_ctor (void *inode_)
+{
+  struct inode *inode = inode_;
+  int i;
+
+  lock_init (&inode->lock_inode);
+  for (i = 0; i < NUM_OF_INDIRECT_POINTER; i++)
+    inode->indirect[i] = NULL;
+  inode->double_indirect = NULL;
+  inode->level2 = NULL;
+}
+
+/* Discards the indirect blocks cached in INODE, which must be
+   done whenever its block tree changes. */
+static void
+inode_map_invalidate (struct inode *inode)
+{
+  int i;
+
+  for (i = 0; i < NUM_OF_INDIRECT_POINTER; i++)
+    {
+      free (inode->indirect[i]);
+      inode->indirect[i] = NULL;
+    }
+  free (inode->double_indirect);
+  inode->double_indirect = NULL;
+  free (inode->level2);
+  inode->level2 = NULL;
+}
+
+/* Returns the open inode for SECTOR, or a null pointer if it is
+   not open.  open_inodes_lock must be held. */
+static struct inode *
+open_inodes_find (block_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector)
+        return inode;
+    }
+  return NULL;
 }
 
 /*
@@ -156,10 +340,11 @@ bool inode_create (block_sector_t sector, off_t length, bool is_dir) {
    disk_inode = calloc (1, sizeof *disk_inode);
    if (disk_inode != NULL) {
       disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
+      disk_inode->magic = INODE_EXTENT_MAGIC;
       disk_inode->is_dir = is_dir;
-      if (inode_allocate(disk_inode, disk_inode->length)) {
-         block_write (fs_device, sector, disk_inode);
+      if (inode_allocate(disk_inode, sector, disk_inode->length, disk_inode->length)) {
+         free_map_flush ();  // before the inode refers to the new sectors
+         cache_write (sector, disk_inode);
          success = true;
       }
       free (disk_inode);
@@ -174,34 +359,42 @@ bool inode_create (block_sector_t sector, off_t length, bool is_dir) {
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *open;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
-        {
-          inode_reopen (inode);
-          return inode;
-        }
-    }
+  rwlock_acquire_read (&open_inodes_lock);
+  inode = open_inodes_find (sector);
+  if (inode != NULL)
+    inode_reopen (inode);
+  rwlock_release_read (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init (&inode->lock_inode);
-  block_read (fs_device, inode->sector, &inode->data);
+  cache_read (inode->sector, &inode->data);
+
+  /* Someone else may have opened it while we were reading. */
+  rwlock_acquire_write (&open_inodes_lock);
+  open = open_inodes_find (sector);
+  if (open != NULL)
+    inode_reopen (open);
+  else
+    list_push_front (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+  if (open != NULL)
+    {
+      kmem_cache_free (&inode_cache, inode);
+      return open;
+    }
   return inode;
 }
 
@@ -228,24 +421,31 @@ inode_get_inumber (const struct inode *inode)
    If INODE was also a removed inode, frees its blocks.
 */
 void inode_close (struct inode *inode) {
+   bool last;
+
    /* Ignore null pointer. */
    if (inode == NULL) return;
 
+   // Drop the count and unlist together, so that inode_open()
+   // cannot find the inode in between.
+   rwlock_acquire_write (&open_inodes_lock);
    lock_acquire (&inode->lock_inode);
-   inode->open_cnt--;
+   last = --inode->open_cnt == 0;
    lock_release (&inode->lock_inode);
-
-   /* Release resources if this was the last opener. */
-   if (inode->open_cnt == 0) {
-      /* Remove from inode list and release lock. */
+   if (last)
       list_remove (&inode->elem);
+   rwlock_release_write (&open_inodes_lock);
 
+   /* Release resources if this was the last opener. */
+   if (last) {
       /* Deallocate blocks if removed. */
       if (inode->removed) {
          free_map_release (inode->sector, 1);
          inode_deallocate(&inode->data);
+         free_map_flush ();
       }
-      free (inode);
+      inode_map_invalidate (inode);
+      kmem_cache_free (&inode_cache, inode);
    }
 }
 
@@ -267,7 +467,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0)
    {
@@ -286,35 +485,75 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0) { // <=0 means min_left = inode_left <= 0, meaning reaching end of file (size must > 0)
         break;               // can be < 0 if seek was called
      }
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
+      if (sector_idx == HOLE_SECTOR)
+        memset (buffer + bytes_read, 0, chunk_size);
       else
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  if (bounce != NULL) free (bounce);
+
+  /* Sequential readers will want the next sector soon. */
+  if (bytes_read > 0 && offset < inode_length (inode))
+    {
+      block_sector_t next = byte_to_sector (inode, offset);
+      if (next != HOLE_SECTOR)
+        cache_readahead (next);
+    }
 
   return bytes_read;
 }
 
+/* Allocates disk sectors for the hole at file sector IDX of INODE,
+   together with the rest of the hole up to file sector END, as one
+   run if possible.  The first and last sectors of the run are
+   zeroed, since the write that fills the hole may cover them only
+   in part; the write covers the sectors in between in full.
+   Returns the disk sector for IDX, or HOLE_SECTOR if the disk is
+   full. */
+static block_sector_t
+inode_fill_hole (struct inode *inode, size_t idx, size_t end)
+{
+  block_sector_t sector, hint, start;
+  size_t cnt = 1;
+  bool lock_held = lock_held_by_current_thread (&inode->lock_inode);
+
+  if (!lock_held)
+    lock_acquire (&inode->lock_inode);
+
+  /* Someone else may have filled the hole first. */
+  sector = sector_lookup (inode, idx);
+  if (sector == HOLE_SECTOR)
+    {
+      while (idx + cnt < end && sector_lookup (inode, idx + cnt) == HOLE_SECTOR)
+        cnt++;
+      hint = idx > 0 ? sector_lookup (inode, idx - 1) : HOLE_SECTOR;
+      hint = hint != HOLE_SECTOR ? hint + 1 : free_map_group (inode->sector);
+
+      cnt = free_map_allocate_extent (hint, cnt, &start);
+      if (cnt > 0)
+        {
+          hint = start + cnt;
+          if (inode_add_run (&inode->data, idx, start, cnt, &hint))
+            {
+              cache_write (start, zeros);
+              cache_write (start + cnt - 1, zeros);
+              sector = start;
+            }
+          else
+            free_map_release (start, cnt);
+          inode_map_invalidate (inode);
+        }
+    }
+
+  if (!lock_held)
+    lock_release (&inode->lock_inode);
+  return sector;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -324,10 +563,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 off_t inode_write_at (struct inode *inode, const void *buffer_, off_t size, off_t offset) {
    const uint8_t *buffer = buffer_;
    off_t bytes_written = 0;
-   uint8_t *bounce = NULL;
+   bool inode_dirty = false;  // inode_disk needs writing back
 
-   if (inode->deny_write_cnt)
+   if (inode->deny_write_cnt || offset >= INODE_MAX_LENGTH)
       return 0;
+   if (size > INODE_MAX_LENGTH - offset)
+      size = INODE_MAX_LENGTH - offset;
 
    while (size > 0)
    {
@@ -350,56 +591,69 @@ off_t inode_write_at (struct inode *inode, const void *buffer_, off_t size, off_
          zeroed blocks. Other file systems do not allocate these blocks at all until
          they are explicitly written. The latter file systems are said to support
          "sparse files." You may adopt either allocation strategy in your file system.
-         We chose the former.
+         We chose the latter, unless inode_prealloc asks for the former: the new
+         length leaves a hole that is allocated sector by sector as it is written.
          */
-         if (inode_allocate(&inode->data, offset+size)) {
-            bool lock_held = lock_held_by_current_thread (&inode->lock_inode);
-            if (!lock_held) lock_acquire(&inode->lock_inode);
+         // hold the lock while allocating, since an extent inode may be converted to a block map
+         bool lock_held = lock_held_by_current_thread (&inode->lock_inode);
+         if (!lock_held) lock_acquire(&inode->lock_inode);
+         bool extended = !inode_prealloc || inode_allocate(&inode->data, inode->sector, offset+size, offset);
+         if (extended) {
+            if (inode_prealloc)
+               inode_map_invalidate (inode);  // allocation filled in new pointers
             inode->data.length = offset + size;
-            if (!lock_held) lock_release(&inode->lock_inode);
-            block_write (fs_device, inode->sector, &inode->data);  // write the new inode information to sector
-            // notice here is the only place besides inode_create that calls allocate
-            // so only need to write inode_disk to sector here
-            continue; // recalculate sector_idx and chuck size
+            inode_dirty = true;
          }
+         if (!lock_held) lock_release(&inode->lock_inode);
+         if (extended)
+            continue; // recalculate sector_idx and chuck size
          else break; // error associate with allocation
       }
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-      {
-         /* Write full sector directly to disk. */
-         block_write (fs_device, sector_idx, buffer + bytes_written);
+      if (sector_idx == HOLE_SECTOR) {
+         // first write into a hole: allocate it, with as much of the rest of the hole as this write covers
+         sector_idx = inode_fill_hole (inode, offset / BLOCK_SECTOR_SIZE, bytes_to_sectors (offset + size));
+         if (sector_idx == HOLE_SECTOR)
+            break;  // disk full
+         inode_dirty = true;
       }
-      else
-      {
-         /* We need a bounce buffer. */
-         if (bounce == NULL)
-         {
-            bounce = malloc (BLOCK_SECTOR_SIZE);
-            if (bounce == NULL)
-            break;
-         }
 
-         /* If the sector contains data before or after the chunk
-         we're writing, then we need to read in the sector
-         first.  Otherwise we start with a sector of all zeros. */
-         if (sector_ofs > 0 || chunk_size < sector_left)
-         block_read (fs_device, sector_idx, bounce);
-         else  memset (bounce, 0, BLOCK_SECTOR_SIZE);
-         memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-         block_write (fs_device, sector_idx, bounce);
-      }
+      cache_write_at (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
    }
-   if (bounce != NULL) free (bounce);
+
+   if (inode_dirty) {
+      bool lock_held = lock_held_by_current_thread (&inode->lock_inode);
+      if (!lock_held) lock_acquire(&inode->lock_inode);
+      free_map_flush ();  // before the inode refers to the new sectors
+      cache_write (inode->sector, &inode->data);  // write the new inode information to sector
+      if (!lock_held) lock_release(&inode->lock_inode);
+   }
 
    return bytes_written;
 }
 
+/* Writes the cached data of INODE between byte offsets OFFSET and
+   OFFSET + SIZE through to disk now, instead of leaving it for
+   write-behind. */
+void
+inode_write_back (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+      if (sector != HOLE_SECTOR && sector != (block_sector_t) -1)
+        cache_write_back (sector);
+    }
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -434,11 +688,186 @@ inode_length (const struct inode *inode)
 }
 
 
-static bool _inode_allocate(block_sector_t * ptr);
+static bool _inode_allocate(block_sector_t * ptr, block_sector_t *hint);
+static bool map_allocate(struct inode_disk *inoded, block_sector_t hint, off_t length);
+static bool extent_allocate(struct inode_disk *inoded, block_sector_t sector, off_t length, off_t write_ofs);
+
 /**
    length: the TOTAL length of the file
+   sector: the sector of the inode itself, which picks the file's allocation group
+   write_ofs: the caller is about to write bytes write_ofs..length, so new
+   sectors entirely inside that range need not be zeroed; pass length if
+   nothing will be written
+   New data is placed in runs of contiguous sectors, starting in the file's
+   allocation group and continuing after its last sector.
+*/
+static bool inode_allocate(struct inode_disk *inoded, block_sector_t sector, off_t length, off_t write_ofs) {
+   ASSERT (length >= 0);
+   ASSERT (write_ofs <= length);
+
+   if (is_extent_inode (inoded))
+      return extent_allocate (inoded, sector, length, write_ofs);
+   return map_allocate (inoded, free_map_group (sector), length);
+}
+
+/* Returns the number of file sectors covered by extent-format INODED. */
+/* Returns the number of file sectors up to the end of the last run of
+   extent-format INODED, and the disk sector just past that run in *NEXT. */
+static size_t extent_end(const struct inode_disk *inoded, block_sector_t *next) {
+   size_t end = 0;
+
+   for (uint32_t i = 0; i < inoded->extent_cnt; i++) {
+      const struct inode_extent *e = &inoded->extents[i];
+      if (e->logical + e->length > end) {
+         end = e->logical + e->length;
+         *next = e->start + e->length;
+      }
+   }
+   return end;
+}
+
+static bool extent_to_map(struct inode_disk *inoded, block_sector_t *hint);
+static bool map_set(struct inode_disk *inoded, size_t idx, block_sector_t sector, block_sector_t *hint);
+
+/**
+   Records that file sectors IDX through IDX+CNT-1 of INODED are in disk
+   sectors START through START+CNT-1.  In an extent inode, a run that
+   continues an extent both in the file and on disk just lengthens it;
+   an extent inode out of extents becomes a block map.  Indirect blocks
+   are allocated near HINT.
+*/
+static bool inode_add_run(struct inode_disk *inoded, size_t idx, block_sector_t start, size_t cnt, block_sector_t *hint) {
+   if (is_extent_inode (inoded)) {
+      for (uint32_t i = 0; i < inoded->extent_cnt; i++) {
+         struct inode_extent *e = &inoded->extents[i];
+         if (e->logical + e->length == idx && e->start + e->length == start) {
+            e->length += cnt;
+            return true;
+         }
+      }
+      if (inoded->extent_cnt < NUM_OF_EXTENTS) {
+         struct inode_extent *e = &inoded->extents[inoded->extent_cnt++];
+         e->logical = idx;
+         e->start = start;
+         e->length = cnt;
+         return true;
+      }
+      // out of extents: continue as a block map
+      if (!extent_to_map (inoded, hint))
+         return false;
+   }
+
+   for (size_t i = 0; i < cnt; i++)
+      if (!map_set (inoded, idx + i, start + i, hint)) {
+         while (i-- > 0)
+            map_set (inoded, idx + i, HOLE_SECTOR, hint);  // caller frees the run
+         return false;
+      }
+   return true;
+}
+
+/**
+   Grows extent-format INODED to cover LENGTH bytes, asking the free map
+   for all the missing sectors as one run and taking what it can get.
+   Holes before the last run are left alone.  New sectors are zeroed,
+   except those entirely inside bytes WRITE_OFS..LENGTH, which the
+   caller is about to overwrite.
+*/
+static bool extent_allocate(struct inode_disk *inoded, block_sector_t sector, off_t length, off_t write_ofs) {
+   size_t want = bytes_to_sectors(length);
+   size_t covered_start = DIV_ROUND_UP (write_ofs, BLOCK_SECTOR_SIZE);
+   size_t covered_end = length / BLOCK_SECTOR_SIZE;
+   block_sector_t hint = free_map_group (sector);
+   size_t have = extent_end(inoded, &hint);
+
+   while (have < want) {
+      block_sector_t start;
+      size_t n = free_map_allocate_extent (hint, want - have, &start);
+      if (n == 0)
+         return false;  // disk full; sectors already added stay with the file
+      hint = start + n;
+      if (!inode_add_run (inoded, have, start, n, &hint)) {
+         free_map_release (start, n);
+         return false;
+      }
+
+      // zero the new sectors, except those the caller is about to overwrite
+      // in full, as inode_fill_hole() does
+      for (size_t i = 0; i < n; i++)
+         if (have + i < covered_start || have + i >= covered_end)
+            cache_write (start + i, zeros);
+      have += n;
+   }
+   return true;
+}
+
+/**
+   Points file sector IDX of block-map INODED at disk sector SECTOR,
+   allocating indirect blocks near HINT as needed.
+*/
+static bool map_set(struct inode_disk *inoded, size_t idx, block_sector_t sector, block_sector_t *hint) {
+   block_sector_t level2;
+
+   if (idx < NUM_OF_DIRECT_POINTER) {
+      inoded->direct_pointer[idx] = sector;
+      return true;
+   }
+   idx -= NUM_OF_DIRECT_POINTER;
+   if (idx < NUM_OF_INDIRECT_POINTER * INDIRECT_POINTERS_PRE_SECTOR) {
+      block_sector_t *indirect = &inoded->indirect_pointer[idx / INDIRECT_POINTERS_PRE_SECTOR];
+      if (!_inode_allocate(indirect, hint))
+         return false;
+      cache_write_at (*indirect, &sector, idx % INDIRECT_POINTERS_PRE_SECTOR * sizeof sector, sizeof sector);
+      return true;
+   }
+   idx -= NUM_OF_INDIRECT_POINTER * INDIRECT_POINTERS_PRE_SECTOR;
+   if (idx < INDIRECT_POINTERS_PRE_SECTOR * INDIRECT_POINTERS_PRE_SECTOR) {
+      off_t level1_ofs = idx / INDIRECT_POINTERS_PRE_SECTOR * sizeof level2;
+      if (!_inode_allocate(&inoded->double_indirect_pointer, hint))
+         return false;
+      cache_read_at (inoded->double_indirect_pointer, &level2, level1_ofs, sizeof level2);
+      if (level2 == 0) {
+         if (!_inode_allocate(&level2, hint))
+            return false;
+         cache_write_at (inoded->double_indirect_pointer, &level2, level1_ofs, sizeof level2);
+      }
+      cache_write_at (level2, &sector, idx % INDIRECT_POINTERS_PRE_SECTOR * sizeof sector, sizeof sector);
+      return true;
+   }
+   return false;  // too large for a block map
+}
+
+/**
+   Converts extent-format INODED to a block map holding the same sectors.
+   On failure INODED is left unchanged, though indirect blocks allocated
+   on the way are lost.
+*/
+static bool extent_to_map(struct inode_disk *inoded, block_sector_t *hint) {
+   struct inode_disk *old = malloc (sizeof *old);
+   if (old == NULL)
+      return false;
+   memcpy (old, inoded, sizeof *old);
+
+   memset (inoded, 0, offsetof (struct inode_disk, length));
+   inoded->magic = INODE_MAGIC;
+   for (uint32_t i = 0; i < old->extent_cnt; i++) {
+      const struct inode_extent *e = &old->extents[i];
+      for (block_sector_t j = 0; j < e->length; j++)
+         if (!map_set (inoded, e->logical + j, e->start + j, hint)) {
+            memcpy (inoded, old, sizeof *old);
+            free (old);
+            return false;
+         }
+   }
+   free (old);
+   return true;
+}
+
+/**
+   Grows block-map INODED to cover LENGTH bytes, allocating each missing
+   sector as close after the previous one as possible, starting at HINT.
 */
-static bool inode_allocate(struct inode_disk *inoded, off_t length) {
+static bool map_allocate(struct inode_disk *inoded, block_sector_t hint, off_t length) {
    ASSERT (length >= 0);
 
    size_t num_of_sectors = bytes_to_sectors(length);  // number of sectors to be allocated (will decrease as we allocate)
@@ -447,7 +876,7 @@ static bool inode_allocate(struct inode_disk *inoded, off_t length) {
    // n is the num of sectors we attempt to allocate in one trial
    int n = num_of_sectors < NUM_OF_DIRECT_POINTER ? num_of_sectors : NUM_OF_DIRECT_POINTER;
    for (int i=0; i < n; i++) {
-      if (!_inode_allocate(&inoded->direct_pointer[i]))
+      if (!_inode_allocate(&inoded->direct_pointer[i], &hint))
          return false;
    }
    num_of_sectors -= n;
@@ -455,23 +884,23 @@ static bool inode_allocate(struct inode_disk *inoded, off_t length) {
 
    // indirect pointers
    for (int i = 0; i < NUM_OF_INDIRECT_POINTER; i++) {
-      if (!_inode_allocate(&inoded->indirect_pointer[i]))
+      if (!_inode_allocate(&inoded->indirect_pointer[i], &hint))
          return false;
       // if the indirect pointer is already allocated, still possibly the next-level direct pointers are not pointing to meaningful sector.
       // read the sector storing all next-level direct pointers into local indptr
       struct inode_indirect_pointer *indptr = malloc(sizeof(struct inode_indirect_pointer));  // we implemented stack growth so hopefully this is fine
-      block_read (fs_device, inoded->indirect_pointer[i], indptr);
+      cache_read (inoded->indirect_pointer[i], indptr);
 
       n = num_of_sectors < INDIRECT_POINTERS_PRE_SECTOR ? num_of_sectors : INDIRECT_POINTERS_PRE_SECTOR;
       // then start assigning data sector to those direct pointers
       for (off_t j=0; j<n; j++) {
-         if (!_inode_allocate(&indptr->sector_ptr[j])) {
+         if (!_inode_allocate(&indptr->sector_ptr[j], &hint)) {
             free(indptr);
             return false;
          }
       }
       // then write content in local indptr to filesys
-      block_write(fs_device, inoded->indirect_pointer[i], indptr);
+      cache_write (inoded->indirect_pointer[i], indptr);
       free(indptr);
       num_of_sectors -= n;
       if (num_of_sectors == 0) return true;  // done allocation
@@ -480,36 +909,36 @@ static bool inode_allocate(struct inode_disk *inoded, off_t length) {
    // double indirect pointer; only 1
    // double_ind_ptr -> level-1 ptr -> level-2 ptr -> data
    // allocate the double indirect pointer if not allocated yet
-   if (!_inode_allocate(&inoded->double_indirect_pointer))
+   if (!_inode_allocate(&inoded->double_indirect_pointer, &hint))
       return false;
    struct inode_indirect_pointer *level1ptr = malloc(sizeof(struct inode_indirect_pointer));
    struct inode_indirect_pointer *level2ptr = malloc(sizeof(struct inode_indirect_pointer));
-   block_read (fs_device, inoded->double_indirect_pointer, level1ptr);
+   cache_read (inoded->double_indirect_pointer, level1ptr);
 
    // each element of level1ptr (sector pointer) still points to a sector full of pointers (may not yet be allocated)
    for (int i=0; i < INDIRECT_POINTERS_PRE_SECTOR; i++) {
-      if (!_inode_allocate(&level1ptr->sector_ptr[i])) {
+      if (!_inode_allocate(&level1ptr->sector_ptr[i], &hint)) {
          free(level1ptr);
          free(level2ptr);
          return false;
       }
-      block_read (fs_device, level1ptr->sector_ptr[i], level2ptr);
+      cache_read (level1ptr->sector_ptr[i], level2ptr);
       // each element of level2ptr (sector ptr) points to a data sector
       // from now on see how many sectors we need for data (equivalent to how many level2ptr in this sector we need)
       n = num_of_sectors < INDIRECT_POINTERS_PRE_SECTOR ? num_of_sectors : INDIRECT_POINTERS_PRE_SECTOR;
       for (off_t j = 0; j < n; j++) {
-         if (!_inode_allocate(&level2ptr->sector_ptr[j])) {
+         if (!_inode_allocate(&level2ptr->sector_ptr[j], &hint)) {
             free(level1ptr);
             free(level2ptr);
             return false;
          }
       }
       // then write content in local level2ptr to filesys
-      block_write(fs_device, level1ptr->sector_ptr[i], level2ptr);
+      cache_write (level1ptr->sector_ptr[i], level2ptr);
       num_of_sectors -= n;
       if (num_of_sectors == 0) {
          //  write content in local level1ptr to filesys (may be newly expanded sectors)
-         block_write(fs_device, inoded->double_indirect_pointer, &level1ptr);
+         cache_write (inoded->double_indirect_pointer, level1ptr);
          free(level1ptr);
          free(level2ptr);
          return true;
@@ -521,15 +950,14 @@ static bool inode_allocate(struct inode_disk *inoded, off_t length) {
    return false;
 }
 
-/* helper function */
-static bool _inode_allocate(block_sector_t * ptr) {
-   static char zeros[BLOCK_SECTOR_SIZE];  // a sector of 0
-
+/* helper function; allocates at or after *HINT and moves the hint past the new sector */
+static bool _inode_allocate(block_sector_t * ptr, block_sector_t *hint) {
    if (*ptr == 0) {  // not allocated
       // allocate sector for the pointers (the sector may be used for pointers or file data)
-      if(! free_map_allocate (1, ptr))  // indirect_pointer[i] should now contain the sector #
+      if (free_map_allocate_extent (*hint, 1, ptr) == 0)  // indirect_pointer[i] should now contain the sector #
          return false;                  // its content should be pointers to the actual data sector
-      block_write(fs_device, *ptr, zeros);  // init to zeros
+      *hint = *ptr + 1;  // keep the file's next sector adjacent
+      cache_write (*ptr, zeros);  // init to zeros
    }
    return true;
 }
@@ -537,43 +965,58 @@ static bool _inode_allocate(block_sector_t * ptr) {
 static void inode_deallocate(struct inode_disk *inoded) {
    ASSERT (inoded->length >= 0);
 
+   if (is_extent_inode (inoded)) {
+      for (uint32_t i = 0; i < inoded->extent_cnt; i++)
+         free_map_release (inoded->extents[i].start, inoded->extents[i].length);
+      return;
+   }
+
    size_t num_of_sectors = bytes_to_sectors(inoded->length);  // number of sectors to be allocated (will decrease as we allocate)
 
    // direct pointers
    int n = num_of_sectors < NUM_OF_DIRECT_POINTER ? num_of_sectors : NUM_OF_DIRECT_POINTER;
+   // holes have no sectors to free: pointers to HOLE_SECTOR are skipped
    for (int i=0; i < n; i++)
-      free_map_release (inoded->direct_pointer[i], 1);
+      if (inoded->direct_pointer[i] != HOLE_SECTOR)
+         free_map_release (inoded->direct_pointer[i], 1);
    num_of_sectors -= n;
    if (num_of_sectors == 0) return;
 
    // indirect pointers
    for (int i = 0; i < NUM_OF_INDIRECT_POINTER; i++) {
-      free_map_release (inoded->indirect_pointer[i], 1); // shouldnt matter to do this first––not ereasing its content
-      struct inode_indirect_pointer indptr;  // we implemented stack growth so hopefully this is fine
-      block_read (fs_device, inoded->indirect_pointer[i], &indptr);
-
       n = num_of_sectors < INDIRECT_POINTERS_PRE_SECTOR ? num_of_sectors : INDIRECT_POINTERS_PRE_SECTOR;
-      // then start assigning data sector to those direct pointers
-      for (off_t j=0; j<n; j++)
-         free_map_release (indptr.sector_ptr[j], 1);
       num_of_sectors -= n;
+      if (inoded->indirect_pointer[i] != HOLE_SECTOR) {
+         free_map_release (inoded->indirect_pointer[i], 1); // shouldnt matter to do this first––not ereasing its content
+         struct inode_indirect_pointer indptr;  // we implemented stack growth so hopefully this is fine
+         cache_read (inoded->indirect_pointer[i], &indptr);
+
+         // then start assigning data sector to those direct pointers
+         for (off_t j=0; j<n; j++)
+            if (indptr.sector_ptr[j] != HOLE_SECTOR)
+               free_map_release (indptr.sector_ptr[j], 1);
+      }
       if (num_of_sectors == 0) return;  // done
    }
 
    // double indirect pointer; only 1
    // double_ind_ptr -> level-1 ptr -> level-2 ptr -> data
+   if (inoded->double_indirect_pointer == HOLE_SECTOR) return;
    free_map_release (inoded->double_indirect_pointer, 1); // shouldnt matter to do this first––not ereasing its content
    struct inode_indirect_pointer level1ptr, level2ptr;
-   block_read (fs_device, inoded->double_indirect_pointer, &level1ptr);
+   cache_read (inoded->double_indirect_pointer, &level1ptr);
 
    for (int i=0; i < INDIRECT_POINTERS_PRE_SECTOR; i++) {
-      free_map_release (level1ptr.sector_ptr[i], 1);
-      block_read (fs_device, level1ptr.sector_ptr[i], &level2ptr);
       // each element of level2ptr (sector ptr) points to a data sector
       n = num_of_sectors < INDIRECT_POINTERS_PRE_SECTOR ? num_of_sectors : INDIRECT_POINTERS_PRE_SECTOR;
-      for (off_t j = 0; j < n; j++)
-         free_map_release (level2ptr.sector_ptr[j], 1);
       num_of_sectors -= n;
+      if (level1ptr.sector_ptr[i] != HOLE_SECTOR) {
+         free_map_release (level1ptr.sector_ptr[i], 1);
+         cache_read (level1ptr.sector_ptr[i], &level2ptr);
+         for (off_t j = 0; j < n; j++)
+            if (level2ptr.sector_ptr[j] != HOLE_SECTOR)
+               free_map_release (level2ptr.sector_ptr[j], 1);
+      }
       if (num_of_sectors == 0) return;
    }
 
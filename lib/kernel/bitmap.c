@@ -23,11 +23,19 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Allocators mostly scan for runs of false bits from the start
+   of the bitmap, and the front of the bitmap tends to fill up.
+   So we keep a hint: every bit below FREE_HINT is known to be
+   true, and scans for false bits start there.  Clearing a bit
+   below the hint lowers it; finding and flipping the first false
+   run raises it.  Scans still return the first fit. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t free_hint;   /* All bits below this index are true. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -69,6 +77,70 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the bits in an element that are at or above bit
+   index OFS within it. */
+static inline elem_type
+mask_from (size_t ofs)
+{
+  return (elem_type) -1 << (ofs % ELEM_BITS);
+}
+
+/* Returns the bits in an element that are below bit index OFS
+   within it, where OFS == ELEM_BITS means all of them. */
+static inline elem_type
+mask_below (size_t ofs)
+{
+  return ofs >= ELEM_BITS ? (elem_type) -1 : ((elem_type) 1 << ofs) - 1;
+}
+
+/* Returns the number of bits set in E.  We do not link against
+   libgcc, so __builtin_popcount() is not available. */
+static inline unsigned
+popcount (elem_type e)
+{
+  e = e - ((e >> 1) & 0x55555555);
+  e = (e & 0x33333333) + ((e >> 2) & 0x33333333);
+  e = (e + (e >> 4)) & 0x0f0f0f0f;
+  return (e * 0x01010101) >> 24;
+}
+
+/* Atomically sets the bits in MASK in B's element IDX to
+   VALUE. */
+static inline void
+set_bits (struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  if (value)
+    asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  else
+    asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Examines a whole element at a time. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx, last;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  e = (value ? b->bits[idx] : ~b->bits[idx]) & mask_from (start);
+  while (e == 0)
+    {
+      if (++idx > last)
+        return end;
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < end ? start : end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -82,6 +154,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->free_hint = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +177,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->free_hint = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -176,6 +250,8 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  if (bit_idx < b->free_hint)
+    b->free_hint = bit_idx;
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +267,8 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  if (bit_idx < b->free_hint)
+    b->free_hint = bit_idx;
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,18 +291,29 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, a whole element at a
+   time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (i = start; i < end; )
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t n = end - i < ELEM_BITS - ofs ? end - i : ELEM_BITS - ofs;
+
+      set_bits (b, elem_idx (i), mask_below (n) << ofs, value);
+      i += n;
+    }
+  if (!value && cnt > 0 && start < b->free_hint)
+    b->free_hint = start;
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,16 +321,23 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type e = value ? b->bits[idx] : ~b->bits[idx];
+
+      value_cnt += popcount (e & (mask_below (n) << ofs));
+      start += n;
+    }
   return value_cnt;
 }
 
@@ -250,16 +346,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +389,31 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      if (!value && i < b->free_hint)
+        i = b->free_hint;
+
+      /* Skip to the next bit set to VALUE, then to the next bit
+         not set to VALUE.  If that run is long enough, we're
+         done; otherwise, resume the search after it. */
+      while (i <= last)
+        {
+          size_t end;
+
+          i = find_next (b, i, last + 1, value);
+          if (i > last)
+            break;
+          end = find_next (b, i, i + cnt, !value);
+          if (end == i + cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -321,7 +430,15 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
 {
   size_t idx = bitmap_scan (b, start, cnt, value);
   if (idx != BITMAP_ERROR) 
-    bitmap_set_multiple (b, idx, cnt, !value);
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+
+      /* If this was the first false bit, everything up to the end
+         of the run is now true. */
+      if (!value && start <= b->free_hint
+          && !bitmap_contains (b, b->free_hint, idx - b->free_hint, false))
+        b->free_hint = idx + cnt;
+    }
   return idx;
 }
 
@@ -346,6 +463,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      b->free_hint = 0;
     }
   return success;
 }
@@ -358,6 +476,24 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes at offset OFS of B's file image, as
+   written by bitmap_write(), to the same place in FILE.  SIZE is
+   trimmed to the end of the image.  Return true if successful,
+   false otherwise. */
+bool
+bitmap_write_at (const struct bitmap *b, struct file *file,
+                 off_t ofs, off_t size)
+{
+  off_t file_size = byte_cnt (b->bit_cnt);
+
+  ASSERT (ofs >= 0 && size >= 0);
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return file_write_at (file, (uint8_t *) b->bits + ofs, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
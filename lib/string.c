@@ -1,5 +1,78 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The block operations below move 32-bit words with the x86
+   string instructions, which handle any alignment but run fastest
+   when the destination is word-aligned, so they first copy or set
+   a few bytes to align it.  memcmp() and strlen() read a word at
+   a time through this type, which may alias anything. */
+typedef uint32_t __attribute__ ((may_alias)) word_t;
+
+/* Repeats byte VALUE in each byte of a word. */
+#define WORD_REPEAT(VALUE) (0x01010101u * (uint8_t) (VALUE))
+
+/* True if any byte in word W is zero.  See "Bit Twiddling
+   Hacks", "Determine if a word has a zero byte". */
+#define WORD_HAS_ZERO(W) \
+        ((((W) - 0x01010101u) & ~(W) & 0x80808080u) != 0)
+
+/* Copies of at least this many bytes go through the SSE2
+   registers, if string_sse2_begin() allows it. */
+#define SSE2_THRESHOLD 1024
+
+/* Supplied by the kernel (see threads/fpu.c) but not by the user
+   library, which shares this file, hence the weak references.
+   string_sse2_begin() returns true if the XMM registers may be
+   used until the matching string_sse2_end(), false if not. */
+bool string_sse2_begin (void) __attribute__ ((weak));
+void string_sse2_end (void) __attribute__ ((weak));
+
+/* Copies SIZE bytes, a multiple of 64, from SRC to DST.  DST must
+   be 16-byte aligned.  Uses non-temporal stores, so that a large
+   copy does not evict the whole cache. */
+static void
+copy_sse2 (void *dst, const void *src, size_t size)
+{
+  for (; size > 0; size -= 64)
+    {
+      asm volatile ("movdqu 0(%1), %%xmm0\n"
+                    "movdqu 16(%1), %%xmm1\n"
+                    "movdqu 32(%1), %%xmm2\n"
+                    "movdqu 48(%1), %%xmm3\n"
+                    "movntdq %%xmm0, 0(%0)\n"
+                    "movntdq %%xmm1, 16(%0)\n"
+                    "movntdq %%xmm2, 32(%0)\n"
+                    "movntdq %%xmm3, 48(%0)\n"
+                    : : "r" (dst), "r" (src) : "memory");
+      dst = (uint8_t *) dst + 64;
+      src = (const uint8_t *) src + 64;
+    }
+  asm volatile ("sfence" : : : "memory");
+}
+
+/* Copies SIZE bytes from SRC to DST, going forward: bytes up to
+   a word boundary in DST, then whole words, then the remaining
+   bytes. */
+static inline void
+copy_forward (unsigned char *dst, const unsigned char *src, size_t size)
+{
+  int d0;
+
+  if (size >= 16)
+    {
+      for (; ((uintptr_t) dst & 3) != 0; size--)
+        *dst++ = *src++;
+      asm volatile ("rep movsl"
+                    : "=&c" (d0), "=&D" (dst), "=&S" (src)
+                    : "0" (size / 4), "1" (dst), "2" (src)
+                    : "memory");
+      size &= 3;
+    }
+  while (size-- > 0)
+    *dst++ = *src++;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,9 +85,21 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  if (size >= SSE2_THRESHOLD && string_sse2_begin != NULL
+      && string_sse2_begin ())
+    {
+      size_t head = -(uintptr_t) dst & 15;
+      size_t body = (size - head) & ~(size_t) 63;
+
+      copy_forward (dst, src, head);
+      copy_sse2 (dst + head, src + head, body);
+      string_sse2_end ();
+      copy_forward (dst + head + body, src + head + body,
+                    size - head - body);
+      return dst_;
+    }
 
+  copy_forward (dst, src, size);
   return dst_;
 }
 
@@ -29,20 +114,29 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
+  if (dst <= src || dst >= src + size) 
+    copy_forward (dst, src, size);
   else 
     {
+      /* The blocks overlap with DST above SRC, so copy backward:
+         the odd bytes at the end first, then whole words with the
+         direction flag set.  The direction flag must be clear
+         again before we return. */
+      int d0, d1, d2;
+
       dst += size;
       src += size;
-      while (size-- > 0)
+      for (; size % 4 != 0; size--)
         *--dst = *--src;
+      asm volatile ("std\n"
+                    "rep movsl\n"
+                    "cld"
+                    : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+                    : "0" (size / 4), "1" (dst - 4), "2" (src - 4)
+                    : "memory");
     }
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +152,10 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  for (; size >= 4; a += 4, b += 4, size -= 4)
+    if (*(const word_t *) a != *(const word_t *) b)
+      break;
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -279,9 +377,23 @@ void *
 memset (void *dst_, int value, size_t size) 
 {
   unsigned char *dst = dst_;
+  int d0, d1;
 
   ASSERT (dst != NULL || size == 0);
   
+  /* Set bytes up to a word boundary, then whole words, then the
+     remaining bytes. */
+  if (size >= 16)
+    {
+      for (; ((uintptr_t) dst & 3) != 0; size--)
+        *dst++ = value;
+      asm volatile ("rep stosl"
+                    : "=&c" (d0), "=&D" (d1)
+                    : "0" (size / 4), "1" (dst), "a" (WORD_REPEAT (value))
+                    : "memory");
+      dst += size & ~(size_t) 3;
+      size &= 3;
+    }
   while (size-- > 0)
     *dst++ = value;
 
@@ -296,8 +408,17 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
-    continue;
+  /* Check bytes up to a word boundary, then whole words until
+     one contains a null byte.  An aligned word never crosses a
+     page boundary, so reading past the terminator within it
+     cannot fault. */
+  for (p = string; ((uintptr_t) p & 3) != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  while (!WORD_HAS_ZERO (*(const word_t *) p))
+    p += 4;
+  while (*p != '\0')
+    p++;
   return p - string;
 }
 
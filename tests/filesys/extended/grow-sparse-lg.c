@@ -0,0 +1,84 @@
+/* Tests that seeking 7 MB past the end of a file and writing a
+   single byte leaves a hole that reads back as zeros, and that
+   the hole is not allocated: the file system partition is 10 MB,
+   so a FILLER_SIZE file fits beside the sparse file only if the
+   write did a constant amount of data I/O however far past the
+   end it landed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Where the byte is written. */
+#define OFFSET (7 * 1024 * 1024)
+
+/* Size of the file written to check for free space. */
+#define FILLER_SIZE (4 * 1024 * 1024)
+
+static char buf[4096];
+
+/* Checks that the SIZE bytes read into buf from offset OFS are
+   all zero. */
+static void
+check_zero (size_t ofs, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu of the hole is %d, not 0", ofs + i, buf[i]);
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  char x = 'x';
+  size_t ofs;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("seek \"%s\" to %d", file_name, OFFSET);
+  seek (fd, OFFSET);
+  CHECK (write (fd, &x, 1) == 1, "write \"%s\"", file_name);
+  CHECK (filesize (fd) == OFFSET + 1, "filesize \"%s\"", file_name);
+
+  /* Sample the start of each megabyte of the hole. */
+  msg ("read \"%s\"", file_name);
+  for (ofs = 0; ofs < OFFSET; ofs += 1024 * 1024)
+    {
+      seek (fd, ofs);
+      if (read (fd, buf, sizeof buf) != sizeof buf)
+        fail ("read %zu bytes at offset %zu failed", sizeof buf, ofs);
+      check_zero (ofs, sizeof buf);
+    }
+
+  /* The end of the hole, then the byte written. */
+  ofs = OFFSET + 1 - sizeof buf;
+  seek (fd, ofs);
+  if (read (fd, buf, sizeof buf) != sizeof buf)
+    fail ("read %zu bytes at offset %zu failed", sizeof buf, ofs);
+  check_zero (ofs, sizeof buf - 1);
+  if (buf[sizeof buf - 1] != 'x')
+    fail ("byte %d is %d, not 'x'", OFFSET, buf[sizeof buf - 1]);
+  msg ("verified contents of \"%s\"", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  /* Fill most of the free space, then give it back so that only
+     the sparse file is archived. */
+  CHECK (create ("filler", 0), "create \"filler\"");
+  CHECK ((fd = open ("filler")) > 1, "open \"filler\"");
+  msg ("write %d bytes to \"filler\"", FILLER_SIZE);
+  memset (buf, 'f', sizeof buf);
+  for (ofs = 0; ofs < FILLER_SIZE; ofs += sizeof buf)
+    if (write (fd, buf, sizeof buf) != sizeof buf)
+      fail ("write %zu bytes at offset %zu in \"filler\" failed",
+            sizeof buf, ofs);
+  msg ("close \"filler\"");
+  close (fd);
+  CHECK (remove ("filler"), "remove \"filler\"");
+}
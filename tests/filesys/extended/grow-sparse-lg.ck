@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) create "testfile"
+(grow-sparse-lg) open "testfile"
+(grow-sparse-lg) seek "testfile" to 7340032
+(grow-sparse-lg) write "testfile"
+(grow-sparse-lg) filesize "testfile"
+(grow-sparse-lg) read "testfile"
+(grow-sparse-lg) verified contents of "testfile"
+(grow-sparse-lg) close "testfile"
+(grow-sparse-lg) create "filler"
+(grow-sparse-lg) open "filler"
+(grow-sparse-lg) write 4194304 bytes to "filler"
+(grow-sparse-lg) close "filler"
+(grow-sparse-lg) remove "filler"
+(grow-sparse-lg) end
+EOF
+pass;
@@ -0,0 +1,148 @@
+/* Test program and microbenchmark for lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time scanning, counting and range
+   operations against a bit-at-a-time reference, then times
+   bitmap_scan_and_flip() the way the page allocator and the
+   free map use it: first-fit allocation from a large, mostly
+   full bitmap.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/test.h"
+
+/* Size of the bitmap used for checking. */
+#define CHECK_BITS 1000
+
+/* Size of the bitmap used for timing: one bit per 4 kB page of
+   512 MB, or per sector of a 64 MB disk. */
+#define BENCH_BITS (128 * 1024)
+
+/* Number of allocations timed per run length. */
+#define BENCH_ALLOCS 1000
+
+static bool ref[CHECK_BITS];
+
+static void check (void);
+static void bench (size_t cnt);
+static size_t ref_scan (size_t start, size_t cnt, bool value);
+
+void
+test (void)
+{
+  check ();
+  printf ("bitmap: all checks passed\n");
+
+  bench (1);
+  bench (8);
+  bench (64);
+}
+
+/* Applies random operations to a bitmap and to a plain array
+   of bools, checking that they agree. */
+static void
+check (void)
+{
+  struct bitmap *b = bitmap_create (CHECK_BITS);
+  int op;
+
+  ASSERT (b != NULL);
+  for (op = 0; op < 100000; op++)
+    {
+      size_t start = random_ulong () % (CHECK_BITS + 1);
+      size_t cnt = random_ulong () % 70;
+      bool value = random_ulong () & 1;
+      size_t i, expect;
+
+      if (start + cnt > CHECK_BITS)
+        cnt = CHECK_BITS - start;
+
+      switch (random_ulong () % 4)
+        {
+        case 0:
+          bitmap_set_multiple (b, start, cnt, value);
+          for (i = start; i < start + cnt; i++)
+            ref[i] = value;
+          break;
+
+        case 1:
+          for (expect = 0, i = start; i < start + cnt; i++)
+            expect += ref[i] == value;
+          ASSERT (bitmap_count (b, start, cnt, value) == expect);
+          ASSERT (bitmap_contains (b, start, cnt, value) == (expect > 0));
+          break;
+
+        case 2:
+          ASSERT (bitmap_scan (b, start, cnt, value)
+                  == ref_scan (start, cnt, value));
+          break;
+
+        case 3:
+          expect = ref_scan (0, cnt, value);
+          ASSERT (bitmap_scan_and_flip (b, 0, cnt, value) == expect);
+          if (expect != BITMAP_ERROR)
+            for (i = expect; i < expect + cnt; i++)
+              ref[i] = !value;
+          break;
+        }
+    }
+  for (op = 0; op < CHECK_BITS; op++)
+    ASSERT (bitmap_test (b, op) == ref[op]);
+  bitmap_destroy (b);
+}
+
+/* Times first-fit allocation of runs of CNT bits from a bitmap
+   whose first 90% is in use, with a free bit every 64 bits to
+   defeat a naive skip. */
+static void
+bench (size_t cnt)
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  uint64_t start, cycles;
+  size_t i;
+
+  ASSERT (b != NULL);
+  bitmap_set_multiple (b, 0, BENCH_BITS / 10 * 9, true);
+  for (i = 0; i < BENCH_BITS / 10 * 9; i += 64)
+    bitmap_reset (b, i);
+
+  start = cpu_cycles ();
+  for (i = 0; i < BENCH_ALLOCS; i++)
+    {
+      size_t idx = bitmap_scan_and_flip (b, 0, cnt, false);
+      ASSERT (idx != BITMAP_ERROR);
+      if (i % 2)
+        bitmap_set_multiple (b, idx, cnt, false);
+    }
+  cycles = cpu_cycles () - start;
+
+  printf ("bitmap: %zu-bit runs: %llu cycles per allocation\n",
+          cnt, (unsigned long long) (cycles / BENCH_ALLOCS));
+  bitmap_destroy (b);
+}
+
+/* Returns the first index at or after START of CNT bits all set
+   to VALUE in REF, or BITMAP_ERROR. */
+static size_t
+ref_scan (size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  if (cnt == 0)
+    return start;
+  for (i = start; i + cnt <= CHECK_BITS; i++)
+    {
+      for (j = 0; j < cnt && ref[i + j] == value; j++)
+        continue;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
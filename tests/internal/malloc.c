@@ -0,0 +1,237 @@
+/* Test program and microbenchmark for threads/malloc.c.
+
+   Checks that blocks of many sizes handed out by malloc(),
+   calloc() and realloc() do not overlap and keep their contents,
+   then times malloc() and free() against a free list behind a
+   lock, which is what every call went through before malloc()
+   had magazines in front of its free lists.  The benchmark runs
+   two patterns: a free right after each malloc(), which stays
+   within the magazine, and bursts of BURST blocks, which refill
+   and drain it.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <list.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/test.h"
+
+/* Number of blocks live at once while checking. */
+#define CHECK_BLOCKS 200
+
+/* Number of malloc()/free() pairs each benchmark times. */
+#define BENCH_REPS 10000
+
+/* Number of blocks allocated before freeing in the burst
+   benchmark. */
+#define BURST 64
+
+static void check (void);
+static void bench (size_t size);
+
+void
+test (void)
+{
+  check ();
+  printf ("malloc: all checks passed\n");
+
+  bench (16);
+  bench (64);
+  bench (512);
+}
+
+/* Fills SIZE bytes at P with a pattern that depends on SEED. */
+static void
+fill (uint8_t *p, size_t size, unsigned seed)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = i * 13 + seed;
+}
+
+/* Checks that SIZE bytes at P hold the pattern fill() put there
+   with SEED. */
+static void
+verify (const uint8_t *p, size_t size, unsigned seed)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    ASSERT (p[i] == (uint8_t) (i * 13 + seed));
+}
+
+/* Allocates CHECK_BLOCKS blocks of random sizes, from 1 byte to
+   several pages, fills each with its own pattern, resizes some,
+   and frees them in random order, checking every block's
+   contents along the way. */
+static void
+check (void)
+{
+  static uint8_t *blocks[CHECK_BLOCKS];
+  static size_t sizes[CHECK_BLOCKS];
+  static size_t order[CHECK_BLOCKS];
+  int round;
+  size_t i;
+
+  for (round = 0; round < 10; round++)
+    {
+      for (i = 0; i < CHECK_BLOCKS; i++)
+        {
+          sizes[i] = (random_ulong () % 4 == 0
+                      ? random_ulong () % 10000 + 1
+                      : random_ulong () % 600 + 1);
+          if (i % 3 == 0)
+            {
+              size_t j;
+
+              blocks[i] = calloc (1, sizes[i]);
+              ASSERT (blocks[i] != NULL);
+              for (j = 0; j < sizes[i]; j++)
+                ASSERT (blocks[i][j] == 0);
+            }
+          else
+            {
+              blocks[i] = malloc (sizes[i]);
+              ASSERT (blocks[i] != NULL);
+            }
+          fill (blocks[i], sizes[i], i);
+        }
+
+      for (i = 0; i < CHECK_BLOCKS; i += 5)
+        {
+          size_t new_size = random_ulong () % 3000 + 1;
+          size_t kept = new_size < sizes[i] ? new_size : sizes[i];
+          blocks[i] = realloc (blocks[i], new_size);
+          ASSERT (blocks[i] != NULL);
+          verify (blocks[i], kept, i);
+          sizes[i] = new_size;
+          fill (blocks[i], sizes[i], i);
+        }
+
+      for (i = 0; i < CHECK_BLOCKS; i++)
+        verify (blocks[i], sizes[i], i);
+
+      for (i = 0; i < CHECK_BLOCKS; i++)
+        order[i] = i;
+      for (i = CHECK_BLOCKS - 1; i > 0; i--)
+        {
+          size_t j = random_ulong () % (i + 1);
+          size_t t = order[i];
+          order[i] = order[j];
+          order[j] = t;
+        }
+      for (i = 0; i < CHECK_BLOCKS; i++)
+        {
+          size_t k = order[i];
+          verify (blocks[k], sizes[k], k);
+          free (blocks[k]);
+        }
+    }
+}
+
+/* Free list behind a lock, as each malloc() and free() used to
+   go through. */
+static struct lock ref_lock;
+static struct list ref_list;
+
+/* Free block in REF_LIST. */
+struct ref_block
+  {
+    struct list_elem elem;
+  };
+
+/* Takes a block from REF_LIST, which must not be empty. */
+static void *
+ref_alloc (void)
+{
+  struct ref_block *b;
+
+  lock_acquire (&ref_lock);
+  b = list_entry (list_pop_front (&ref_list), struct ref_block, elem);
+  lock_release (&ref_lock);
+  return b;
+}
+
+/* Puts block P on REF_LIST. */
+static void
+ref_free (void *p)
+{
+  struct ref_block *b = p;
+
+  lock_acquire (&ref_lock);
+  list_push_front (&ref_list, &b->elem);
+  lock_release (&ref_lock);
+}
+
+/* Times BENCH_REPS malloc()/free() pairs of SIZE-byte blocks in
+   each pattern, with malloc() and with the reference free list,
+   and prints the cycles per pair. */
+static void
+bench (size_t size)
+{
+  void *burst[BURST];
+  uint64_t start, pair, ref_pair, bursts, ref_bursts;
+  int i, j;
+
+  /* Stock the reference list with BURST blocks. */
+  lock_init (&ref_lock);
+  list_init (&ref_list);
+  for (j = 0; j < BURST; j++)
+    {
+      burst[j] = malloc (size);
+      ASSERT (burst[j] != NULL);
+    }
+  for (j = 0; j < BURST; j++)
+    ref_free (burst[j]);
+
+  start = cpu_cycles ();
+  for (i = 0; i < BENCH_REPS; i++)
+    free (malloc (size));
+  pair = cpu_cycles () - start;
+
+  start = cpu_cycles ();
+  for (i = 0; i < BENCH_REPS; i++)
+    ref_free (ref_alloc ());
+  ref_pair = cpu_cycles () - start;
+
+  start = cpu_cycles ();
+  for (i = 0; i < BENCH_REPS / BURST; i++)
+    {
+      for (j = 0; j < BURST; j++)
+        burst[j] = malloc (size);
+      for (j = 0; j < BURST; j++)
+        free (burst[j]);
+    }
+  bursts = cpu_cycles () - start;
+
+  start = cpu_cycles ();
+  for (i = 0; i < BENCH_REPS / BURST; i++)
+    {
+      for (j = 0; j < BURST; j++)
+        burst[j] = ref_alloc ();
+      for (j = 0; j < BURST; j++)
+        ref_free (burst[j]);
+    }
+  ref_bursts = cpu_cycles () - start;
+
+  while (!list_empty (&ref_list))
+    free (list_entry (list_pop_front (&ref_list), struct ref_block, elem));
+
+  printf ("malloc: %zu-byte pairs: %llu vs. %llu cycles per pair\n",
+          size, (unsigned long long) (pair / BENCH_REPS),
+          (unsigned long long) (ref_pair / BENCH_REPS));
+  printf ("malloc: %zu-byte bursts of %d: %llu vs. %llu cycles per pair\n",
+          size, BURST,
+          (unsigned long long) (bursts / (BENCH_REPS / BURST * BURST)),
+          (unsigned long long) (ref_bursts / (BENCH_REPS / BURST * BURST)));
+}
@@ -0,0 +1,66 @@
+/* Tests cond_wait_timeout().  A wait that nobody signals must
+   give up after the time limit, and a wait that is signaled
+   before the limit must return as soon as it is signaled.  The
+   lock must be held again on return either way. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func signal_thread;
+static struct lock lock;
+static struct condition condition;
+
+void
+test_cond_timeout (void) 
+{
+  int64_t start, elapsed;
+
+  lock_init (&lock);
+  cond_init (&condition);
+
+  /* Expiry. */
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  if (cond_wait_timeout (&condition, &lock, 10))
+    fail ("cond_wait_timeout() returned true without a signal");
+  elapsed = timer_elapsed (start);
+  if (elapsed < 10)
+    fail ("cond_wait_timeout() gave up after %lld ticks, not 10", elapsed);
+  if (!lock_held_by_current_thread (&lock))
+    fail ("lock not held after cond_wait_timeout() timed out");
+  msg ("Timed out.");
+
+  /* The timed-out waiter must be gone. */
+  if (!list_empty (&condition.waiters))
+    fail ("timed-out waiter left on the condition");
+  lock_release (&lock);
+
+  /* Wakeup before expiry. */
+  thread_create ("signal", PRI_DEFAULT, signal_thread, NULL);
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  if (!cond_wait_timeout (&condition, &lock, 1000))
+    fail ("cond_wait_timeout() timed out although it was signaled");
+  elapsed = timer_elapsed (start);
+  if (elapsed >= 1000)
+    fail ("cond_wait_timeout() took %lld ticks", elapsed);
+  if (!lock_held_by_current_thread (&lock))
+    fail ("lock not held after cond_wait_timeout() was signaled");
+  msg ("Woke up before the time limit.");
+  lock_release (&lock);
+}
+
+/* Signals the condition after a short delay. */
+static void
+signal_thread (void *aux UNUSED) 
+{
+  timer_sleep (5);
+  lock_acquire (&lock);
+  msg ("Signaling the condition.");
+  cond_signal (&condition, &lock);
+  lock_release (&lock);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cond-timeout) begin
+(cond-timeout) Timed out.
+(cond-timeout) Signaling the condition.
+(cond-timeout) Woke up before the time limit.
+(cond-timeout) end
+EOF
+pass;
@@ -0,0 +1,65 @@
+/* Tests admission control in thread_set_deadline().  Reservations
+   that would take the reserved share of the CPU above 90% must be
+   refused, while a thread may always shrink or replace its own
+   reservation within the limit. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reserve_thread;
+static struct semaphore reserved, done;
+
+/* Calls thread_set_deadline (PERIOD, BUDGET) and fails unless
+   it returns EXPECTED. */
+static void
+try_deadline (int64_t period, int64_t budget, bool expected) 
+{
+  bool admitted = thread_set_deadline (period, budget);
+  if (admitted != expected)
+    fail ("%lld of every %lld ticks %s, expected it to be %s",
+          budget, period, admitted ? "admitted" : "refused",
+          expected ? "admitted" : "refused");
+  msg ("%lld of every %lld ticks %s.", budget, period,
+       admitted ? "admitted" : "refused");
+}
+
+void
+test_edf_admit (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* One thread alone. */
+  try_deadline (10, 9, true);
+  try_deadline (10, 10, false);
+  try_deadline (100, 91, false);
+  try_deadline (100, 90, true);
+  if (!thread_set_deadline (0, 0))
+    fail ("releasing the reservation failed");
+
+  /* Another thread holds half of the CPU. */
+  sema_init (&reserved, 0);
+  sema_init (&done, 0);
+  thread_create ("reserve", PRI_DEFAULT, reserve_thread, NULL);
+  sema_down (&reserved);
+  try_deadline (10, 5, false);
+  try_deadline (10, 4, true);
+  if (!thread_set_deadline (0, 0))
+    fail ("releasing the reservation failed");
+  sema_up (&done);
+}
+
+/* Reserves half of the CPU until the main thread is done. */
+static void
+reserve_thread (void *aux UNUSED) 
+{
+  if (!thread_set_deadline (10, 5))
+    fail ("first reservation refused");
+  msg ("Reserved 5 of every 10 ticks.");
+  sema_up (&reserved);
+  sema_down (&done);
+  thread_set_deadline (0, 0);
+}
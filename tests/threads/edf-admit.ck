@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-admit) begin
+(edf-admit) 9 of every 10 ticks admitted.
+(edf-admit) 10 of every 10 ticks refused.
+(edf-admit) 91 of every 100 ticks refused.
+(edf-admit) 90 of every 100 ticks admitted.
+(edf-admit) Reserved 5 of every 10 ticks.
+(edf-admit) 5 of every 10 ticks refused.
+(edf-admit) 4 of every 10 ticks admitted.
+(edf-admit) end
+EOF
+pass;
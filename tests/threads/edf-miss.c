@@ -0,0 +1,75 @@
+/* Tests the EDF deadline-miss counter.  A thread that blocks in
+   every period finishes its work in time and must not add
+   misses; a thread that is still runnable at its deadlines must
+   add one miss per period. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PERIOD 10
+#define BUDGET 3
+#define PERIODS 4
+
+static thread_func punctual_thread, late_thread;
+static struct semaphore done;
+
+void
+test_edf_miss (void) 
+{
+  long long misses;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  misses = thread_get_deadline_misses ();
+  thread_create ("punctual", PRI_DEFAULT, punctual_thread, NULL);
+  sema_down (&done);
+  if (thread_get_deadline_misses () != misses)
+    fail ("%lld deadlines missed by a thread that blocked every period",
+          thread_get_deadline_misses () - misses);
+  msg ("Thread that blocked every period missed no deadlines.");
+
+  misses = thread_get_deadline_misses ();
+  thread_create ("late", PRI_DEFAULT, late_thread, NULL);
+  sema_down (&done);
+  if (thread_get_deadline_misses () - misses < PERIODS - 1)
+    fail ("only %lld deadlines missed by a thread that never blocked",
+          thread_get_deadline_misses () - misses);
+  msg ("Thread that never blocked missed its deadlines.");
+}
+
+/* Does a little work, then sleeps until the next period, for
+   PERIODS periods. */
+static void
+punctual_thread (void *aux UNUSED) 
+{
+  int i;
+
+  if (!thread_set_deadline (PERIOD, BUDGET))
+    fail ("reservation refused");
+  for (i = 0; i < PERIODS; i++)
+    timer_sleep (thread_current ()->edf_deadline - timer_ticks ());
+  thread_set_deadline (0, 0);
+  sema_up (&done);
+}
+
+/* Spins for PERIODS periods without blocking. */
+static void
+late_thread (void *aux UNUSED) 
+{
+  int64_t start;
+
+  if (!thread_set_deadline (PERIOD, BUDGET))
+    fail ("reservation refused");
+  start = timer_ticks ();
+  while (timer_elapsed (start) < PERIODS * PERIOD)
+    continue;
+  thread_set_deadline (0, 0);
+  sema_up (&done);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-miss) begin
+(edf-miss) Thread that blocked every period missed no deadlines.
+(edf-miss) Thread that never blocked missed its deadlines.
+(edf-miss) end
+EOF
+pass;
@@ -0,0 +1,73 @@
+/* Tests an EDF thread that needs more CPU time than it reserved.
+   Once its budget for a period is spent it must fall back to its
+   static priority, so that a busy higher-priority thread keeps
+   it off the CPU, and it must run again at the start of each new
+   period. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PERIOD 20
+#define BUDGET 5
+#define PERIODS 3
+
+static thread_func spin_thread;
+static struct semaphore started, done;
+static int64_t start;
+static int ran[PERIODS];
+static volatile bool stop;
+
+void
+test_edf_overrun (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&started, 0);
+  sema_init (&done, 0);
+  thread_create ("spin", PRI_MIN, spin_thread, NULL);
+  sema_down (&started);
+
+  /* Keep the CPU busy at PRI_DEFAULT for PERIODS periods. */
+  while (timer_elapsed (start) < PERIODS * PERIOD)
+    continue;
+  stop = true;
+  sema_down (&done);
+
+  /* The spinning thread runs up to BUDGET ticks of each period,
+     plus one partial tick where its budget ran out. */
+  for (i = 0; i < PERIODS; i++)
+    if (ran[i] < 1 || ran[i] > BUDGET + 1)
+      fail ("EDF thread ran in %d ticks of period %d", ran[i], i);
+  msg ("EDF thread ran in every period, within its budget.");
+}
+
+/* Reserves BUDGET ticks out of every PERIOD, then spins, counting
+   the ticks in each period in which it ran. */
+static void
+spin_thread (void *aux UNUSED) 
+{
+  int64_t last = -1;
+
+  if (!thread_set_deadline (PERIOD, BUDGET))
+    fail ("reservation refused");
+  start = thread_current ()->edf_deadline - PERIOD;
+  sema_up (&started);
+
+  while (!stop)
+    {
+      int64_t now = timer_ticks ();
+      int period = (now - start) / PERIOD;
+      if (now != last && period < PERIODS)
+        ran[period]++;
+      last = now;
+    }
+  thread_set_deadline (0, 0);
+  sema_up (&done);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-overrun) begin
+(edf-overrun) EDF thread ran in every period, within its budget.
+(edf-overrun) end
+EOF
+pass;
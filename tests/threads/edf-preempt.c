@@ -0,0 +1,50 @@
+/* Tests that an EDF thread with budget left preempts a thread of
+   higher static priority.  The main thread busy-waits at
+   PRI_DEFAULT while a PRI_MIN thread with a reservation wakes up
+   from a sleep; the EDF thread must run right away rather than
+   wait for the main thread to give up the CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func edf_thread;
+static struct semaphore started;
+static volatile bool edf_ran;
+
+void
+test_edf_preempt (void) 
+{
+  int64_t start;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&started, 0);
+  thread_create ("edf", PRI_MIN, edf_thread, NULL);
+  sema_down (&started);
+
+  /* Busy-wait without blocking or yielding. */
+  start = timer_ticks ();
+  while (!edf_ran)
+    if (timer_elapsed (start) > 100)
+      fail ("EDF thread did not preempt the main thread");
+  msg ("Main thread saw the EDF thread run.");
+}
+
+/* Reserves CPU time, then sleeps so that it wakes up while the
+   main thread is busy. */
+static void
+edf_thread (void *aux UNUSED) 
+{
+  if (!thread_set_deadline (50, 10))
+    fail ("reservation refused");
+  sema_up (&started);
+  timer_sleep (5);
+  msg ("EDF thread running at priority %d.", thread_get_priority ());
+  edf_ran = true;
+  thread_set_deadline (0, 0);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-preempt) begin
+(edf-preempt) EDF thread running at priority 0.
+(edf-preempt) Main thread saw the EDF thread run.
+(edf-preempt) end
+EOF
+pass;
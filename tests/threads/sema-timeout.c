@@ -0,0 +1,57 @@
+/* Tests sema_down_timeout().  A wait on a semaphore that nobody
+   ups must give up after the time limit, without leaving the
+   waiter behind on the semaphore, and a wait that is satisfied
+   before the limit must return as soon as the semaphore is
+   upped. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func up_thread;
+static struct semaphore sema;
+
+void
+test_sema_timeout (void) 
+{
+  int64_t start, elapsed;
+
+  sema_init (&sema, 0);
+
+  /* Expiry. */
+  start = timer_ticks ();
+  if (sema_down_timeout (&sema, 10))
+    fail ("sema_down_timeout() succeeded on a semaphore nobody upped");
+  elapsed = timer_elapsed (start);
+  if (elapsed < 10)
+    fail ("sema_down_timeout() gave up after %lld ticks, not 10", elapsed);
+  msg ("Timed out.");
+
+  /* The timed-out waiter must be gone, so an up is not lost. */
+  sema_up (&sema);
+  if (!sema_try_down (&sema))
+    fail ("sema_up() after a timeout was lost");
+  msg ("Semaphore value is intact.");
+
+  /* Wakeup before expiry. */
+  thread_create ("up", PRI_DEFAULT, up_thread, NULL);
+  start = timer_ticks ();
+  if (!sema_down_timeout (&sema, 1000))
+    fail ("sema_down_timeout() timed out although the semaphore was upped");
+  elapsed = timer_elapsed (start);
+  if (elapsed >= 1000)
+    fail ("sema_down_timeout() took %lld ticks", elapsed);
+  msg ("Woke up before the time limit.");
+}
+
+/* Ups the semaphore after a short delay. */
+static void
+up_thread (void *aux UNUSED) 
+{
+  timer_sleep (5);
+  msg ("Upping the semaphore.");
+  sema_up (&sema);
+}
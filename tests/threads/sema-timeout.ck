@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sema-timeout) begin
+(sema-timeout) Timed out.
+(sema-timeout) Semaphore value is intact.
+(sema-timeout) Upping the semaphore.
+(sema-timeout) Woke up before the time limit.
+(sema-timeout) end
+EOF
+pass;
@@ -18,6 +18,10 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"sema-timeout", test_sema_timeout},
+    {"cond-timeout", test_cond_timeout},
+    {"timer-event-periodic", test_timer_event_periodic},
+    {"timer-event-cancel", test_timer_event_cancel},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -30,6 +34,10 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"edf-admit", test_edf_admit},
+    {"edf-preempt", test_edf_preempt},
+    {"edf-overrun", test_edf_overrun},
+    {"edf-miss", test_edf_miss},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
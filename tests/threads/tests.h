@@ -12,6 +12,10 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_sema_timeout;
+extern test_func test_cond_timeout;
+extern test_func test_timer_event_periodic;
+extern test_func test_timer_event_cancel;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -24,6 +28,10 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_edf_admit;
+extern test_func test_edf_preempt;
+extern test_func test_edf_overrun;
+extern test_func test_edf_miss;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
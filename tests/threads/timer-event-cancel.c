@@ -0,0 +1,51 @@
+/* Tests timer_event_cancel().  A one-shot event cancelled before
+   it expires must never fire, cancelling it again or after it has
+   fired must report that it was not pending, and an event may be
+   re-added after it is cancelled. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static timer_event_func count_event;
+static int fire_cnt;
+
+void
+test_timer_event_cancel (void) 
+{
+  struct timer_event ev;
+
+  timer_event_init (&ev, count_event, NULL);
+
+  /* Cancel before expiry. */
+  timer_event_add (&ev, 20);
+  if (!timer_event_pending (&ev))
+    fail ("event not pending after timer_event_add()");
+  if (!timer_event_cancel (&ev))
+    fail ("timer_event_cancel() did not find the pending event");
+  if (timer_event_cancel (&ev))
+    fail ("second timer_event_cancel() found the event pending");
+  timer_sleep (30);
+  if (fire_cnt != 0)
+    fail ("cancelled event fired");
+  msg ("Cancelled event did not fire.");
+
+  /* Re-add and let it fire. */
+  timer_event_add (&ev, 10);
+  timer_sleep (20);
+  if (fire_cnt != 1)
+    fail ("re-added event fired %d times, not once", fire_cnt);
+  if (timer_event_pending (&ev) || timer_event_cancel (&ev))
+    fail ("one-shot event still pending after firing");
+  msg ("Re-added event fired once.");
+}
+
+/* Counts firings. */
+static void
+count_event (struct timer_event *ev UNUSED, void *aux UNUSED) 
+{
+  fire_cnt++;
+}
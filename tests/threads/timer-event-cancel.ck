@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timer-event-cancel) begin
+(timer-event-cancel) Cancelled event did not fire.
+(timer-event-cancel) Re-added event fired once.
+(timer-event-cancel) end
+EOF
+pass;
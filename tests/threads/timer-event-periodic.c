@@ -0,0 +1,64 @@
+/* Tests timer_event_add_periodic().  A periodic event must fire
+   once per period, PERIOD ticks apart, until it is cancelled. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PERIOD 7
+#define FIRINGS 5
+
+static timer_event_func tick_event;
+static struct semaphore fired;
+static int64_t fire_times[FIRINGS];
+static int fire_cnt;
+
+void
+test_timer_event_periodic (void) 
+{
+  struct timer_event ev;
+  int64_t start;
+  int i;
+
+  sema_init (&fired, 0);
+  timer_event_init (&ev, tick_event, NULL);
+
+  /* Start on a tick boundary. */
+  timer_sleep (1);
+  start = timer_ticks ();
+  timer_event_add_periodic (&ev, PERIOD);
+  for (i = 0; i < FIRINGS; i++)
+    sema_down (&fired);
+  if (!timer_event_cancel (&ev))
+    fail ("periodic event was not pending after firing");
+
+  for (i = 0; i < FIRINGS; i++)
+    {
+      int64_t expected = start + (i + 1) * PERIOD;
+      if (fire_times[i] != expected)
+        fail ("firing %d at tick %lld, expected tick %lld",
+              i, fire_times[i], expected);
+    }
+  msg ("Fired %d times, %d ticks apart.", FIRINGS, PERIOD);
+
+  /* Cancelled: no more firings. */
+  timer_sleep (3 * PERIOD);
+  if (fire_cnt != FIRINGS)
+    fail ("fired %d times after being cancelled", fire_cnt - FIRINGS);
+  msg ("No firings after cancel.");
+}
+
+/* Records the time of each firing. */
+static void
+tick_event (struct timer_event *ev UNUSED, void *aux UNUSED) 
+{
+  if (fire_cnt < FIRINGS)
+    {
+      fire_times[fire_cnt] = timer_ticks ();
+      sema_up (&fired);
+    }
+  fire_cnt++;
+}
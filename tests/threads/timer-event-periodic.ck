@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timer-event-periodic) begin
+(timer-event-periodic) Fired 5 times, 7 ticks apart.
+(timer-event-periodic) No firings after cancel.
+(timer-event-periodic) end
+EOF
+pass;
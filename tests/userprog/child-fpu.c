@@ -0,0 +1,192 @@
+/* Child process run by the fpu-switch test.
+
+   Loads values derived from the number given as the first
+   command-line argument into all eight x87 and all eight XMM
+   registers, together with its own x87 control word and MXCSR
+   rounding mode.  It then makes read and write system calls of
+   BUF_SIZE bytes, doubles every register, makes more system
+   calls, and checks that every register holds exactly the
+   expected value.  Another copy of this program does the same
+   with different values at the same time, so the kernel must
+   keep each process's FPU state apart across context switches
+   and across its own use of the XMM registers.
+
+   User programs are built with -msoft-float, so the compiler
+   never touches these registers itself. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-fpu";
+
+#define STEPS 8
+#define BUF_SIZE 1024
+
+static int xmm[8][4], x87[8];
+static char buf[BUF_SIZE], buf2[BUF_SIZE];
+
+/* Loads XMM into xmm0...xmm7 and X87 into the x87 stack, with
+   X87[0] at the top, and sets the rounding controls. */
+static void
+load_state (uint16_t fcw, uint32_t mxcsr)
+{
+  asm volatile ("finit\n"
+                "fldcw %0\n"
+                "ldmxcsr %1\n"
+                : : "m" (fcw), "m" (mxcsr));
+  asm volatile ("movdqu 0(%0), %%xmm0\n"
+                "movdqu 16(%0), %%xmm1\n"
+                "movdqu 32(%0), %%xmm2\n"
+                "movdqu 48(%0), %%xmm3\n"
+                "movdqu 64(%0), %%xmm4\n"
+                "movdqu 80(%0), %%xmm5\n"
+                "movdqu 96(%0), %%xmm6\n"
+                "movdqu 112(%0), %%xmm7\n"
+                : : "r" (xmm) : "memory");
+  asm volatile ("fildl 28(%0)\n"
+                "fildl 24(%0)\n"
+                "fildl 20(%0)\n"
+                "fildl 16(%0)\n"
+                "fildl 12(%0)\n"
+                "fildl 8(%0)\n"
+                "fildl 4(%0)\n"
+                "fildl 0(%0)\n"
+                : : "r" (x87) : "memory");
+}
+
+/* Doubles every x87 and XMM register, using floating-point
+   arithmetic, without touching memory. */
+static void
+double_state (void)
+{
+#define DOUBLE_XMM(N)                           \
+  "cvtdq2ps %%xmm" #N ", %%xmm" #N "\n"         \
+  "addps %%xmm" #N ", %%xmm" #N "\n"            \
+  "cvttps2dq %%xmm" #N ", %%xmm" #N "\n"
+#define DOUBLE_X87(N)                           \
+  "fxch %%st(" #N ")\n"                         \
+  "fadd %%st(0), %%st\n"                        \
+  "fxch %%st(" #N ")\n"
+  asm volatile (DOUBLE_XMM (0) DOUBLE_XMM (1) DOUBLE_XMM (2)
+                DOUBLE_XMM (3) DOUBLE_XMM (4) DOUBLE_XMM (5)
+                DOUBLE_XMM (6) DOUBLE_XMM (7)
+                "fadd %%st(0), %%st\n"
+                DOUBLE_X87 (1) DOUBLE_X87 (2) DOUBLE_X87 (3)
+                DOUBLE_X87 (4) DOUBLE_X87 (5) DOUBLE_X87 (6)
+                DOUBLE_X87 (7)
+                : : );
+#undef DOUBLE_XMM
+#undef DOUBLE_X87
+}
+
+/* Stores xmm0...xmm7 into XMM and pops the x87 stack into X87,
+   and the rounding controls into *FCW and *MXCSR. */
+static void
+store_state (uint16_t *fcw, uint32_t *mxcsr)
+{
+  asm volatile ("movdqu %%xmm0, 0(%0)\n"
+                "movdqu %%xmm1, 16(%0)\n"
+                "movdqu %%xmm2, 32(%0)\n"
+                "movdqu %%xmm3, 48(%0)\n"
+                "movdqu %%xmm4, 64(%0)\n"
+                "movdqu %%xmm5, 80(%0)\n"
+                "movdqu %%xmm6, 96(%0)\n"
+                "movdqu %%xmm7, 112(%0)\n"
+                : : "r" (xmm) : "memory");
+  asm volatile ("fistpl 0(%0)\n"
+                "fistpl 4(%0)\n"
+                "fistpl 8(%0)\n"
+                "fistpl 12(%0)\n"
+                "fistpl 16(%0)\n"
+                "fistpl 20(%0)\n"
+                "fistpl 24(%0)\n"
+                "fistpl 28(%0)\n"
+                : : "r" (x87) : "memory");
+  asm volatile ("fnstcw %0\n"
+                "stmxcsr %1\n"
+                : "=m" (*fcw), "=m" (*mxcsr));
+}
+
+/* Writes BUF_SIZE bytes of VALUE at the current position of FD,
+   then reads them back. */
+static void
+exercise_io (int fd, int value)
+{
+  int pos = tell (fd);
+
+  memset (buf, value, sizeof buf);
+  if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+    fail ("write failed");
+  seek (fd, pos);
+  if (read (fd, buf2, sizeof buf2) != (int) sizeof buf2)
+    fail ("read failed");
+  if (memcmp (buf, buf2, sizeof buf))
+    fail ("read back wrong data");
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  char file_name[16];
+  uint16_t fcw;
+  uint32_t mxcsr;
+  int id, fd, step, i, j;
+
+  if (argc != 2)
+    fail ("bad command-line arguments");
+  id = atoi (argv[1]);
+
+  /* Give each copy its own rounding mode: down for copy 1, up
+     for copy 2.  Neither affects the integer-valued arithmetic
+     below, but both must survive. */
+  fcw = 0x037f | (id << 10);
+  mxcsr = 0x1f80 | (id << 13);
+
+  snprintf (file_name, sizeof file_name, "fpu-%d", id);
+  if (!create (file_name, 0))
+    fail ("create \"%s\"", file_name);
+  fd = open (file_name);
+  if (fd < 2)
+    fail ("open \"%s\"", file_name);
+
+  for (step = 0; step < STEPS; step++)
+    {
+      uint16_t fcw_out;
+      uint32_t mxcsr_out;
+
+      for (i = 0; i < 8; i++)
+        {
+          for (j = 0; j < 4; j++)
+            xmm[i][j] = id * 100000 + step * 1000 + i * 10 + j;
+          x87[i] = -(id * 100000 + step * 1000 + i);
+        }
+
+      load_state (fcw, mxcsr);
+      exercise_io (fd, id + step);
+      double_state ();
+      exercise_io (fd, id - step);
+      store_state (&fcw_out, &mxcsr_out);
+
+      if (fcw_out != fcw)
+        fail ("step %d: x87 control word %04x, expected %04x",
+              step, fcw_out, fcw);
+      if ((mxcsr_out & 0xffc0) != mxcsr)
+        fail ("step %d: MXCSR %08x, expected %08x",
+              step, mxcsr_out, mxcsr);
+      for (i = 0; i < 8; i++)
+        {
+          for (j = 0; j < 4; j++)
+            if (xmm[i][j] != 2 * (id * 100000 + step * 1000 + i * 10 + j))
+              fail ("step %d: xmm%d[%d] is %d", step, i, j, xmm[i][j]);
+          if (x87[i] != -2 * (id * 100000 + step * 1000 + i))
+            fail ("step %d: st(%d) is %d", step, i, x87[i]);
+        }
+    }
+
+  close (fd);
+  return 0;
+}
@@ -0,0 +1,24 @@
+/* Runs two child processes at once that each keep values in all
+   of the x87 and XMM registers across read and write system
+   calls, and checks that both finish with exactly the expected
+   results.  See child-fpu.c for details. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t a, b;
+  int status_a, status_b;
+
+  a = exec ("child-fpu 1");
+  b = exec ("child-fpu 2");
+  if (a == PID_ERROR || b == PID_ERROR)
+    fail ("exec failed");
+  status_a = wait (a);
+  status_b = wait (b);
+  msg ("child 1 exited with status %d", status_a);
+  msg ("child 2 exited with status %d", status_b);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fpu-switch) begin
+child-fpu: exit(0)
+child-fpu: exit(0)
+(fpu-switch) child 1 exited with status 0
+(fpu-switch) child 2 exited with status 0
+(fpu-switch) end
+fpu-switch: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdint.h>
+
+struct thread;
+
+/* State of the processor.
+
+   Pintos runs only on the bootstrap processor, so there is a
+   single struct cpu, returned by cpu_current().  It holds the
+   state that belongs to the processor rather than to any one
+   thread. */
+struct cpu
+  {
+    struct thread *idle;                /* Idle thread. */
+    struct thread *fpu_owner;           /* Thread whose state the FPU holds. */
+
+    /* Statistics, owned by thread.c. */
+    unsigned time_slice;                /* # of timer ticks since last yield. */
+    long long idle_ticks;               /* # of timer ticks spent idle. */
+    long long kernel_ticks;             /* # of timer ticks in kernel threads. */
+    long long user_ticks;               /* # of timer ticks in user programs. */
+  };
+
+extern struct cpu boot_cpu;
+
+/* Returns the CPU we are running on. */
+static inline struct cpu *
+cpu_current (void)
+{
+  return &boot_cpu;
+}
+
+/* Returns the CPU's time-stamp counter, which counts
+   clock cycles.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+cpu_cycles (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
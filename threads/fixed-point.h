@@ -0,0 +1,74 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the 4.4BSD
+   scheduler.  A fixed_t holds a real number X as the integer
+   X * FP_F: 17 bits before the binary point, 14 bits after it,
+   and a sign bit.  The kernel is built with -msoft-float, so
+   this is how load_avg and recent_cpu keep their fractions.
+
+   Mixed operations take the fixed-point operand first and the
+   plain integer second. */
+typedef int32_t fixed_t;
+
+#define FP_SHIFT 14                     /* Bits after the binary point. */
+#define FP_F (1 << FP_SHIFT)            /* Fixed-point 1.0. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t fp_from_int (int n) {
+  return n * FP_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int fp_to_int (fixed_t x) {
+  return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int fp_round (fixed_t x) {
+  return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+/* Returns X + Y. */
+static inline fixed_t fp_add (fixed_t x, fixed_t y) {
+  return x + y;
+}
+
+/* Returns X - Y. */
+static inline fixed_t fp_sub (fixed_t x, fixed_t y) {
+  return x - y;
+}
+
+/* Returns X + N. */
+static inline fixed_t fp_add_int (fixed_t x, int n) {
+  return x + n * FP_F;
+}
+
+/* Returns X - N. */
+static inline fixed_t fp_sub_int (fixed_t x, int n) {
+  return x - n * FP_F;
+}
+
+/* Returns X * Y.  The intermediate product needs 64 bits. */
+static inline fixed_t fp_mul (fixed_t x, fixed_t y) {
+  return ((int64_t) x) * y / FP_F;
+}
+
+/* Returns X * N. */
+static inline fixed_t fp_mul_int (fixed_t x, int n) {
+  return x * n;
+}
+
+/* Returns X / Y.  The scaled dividend needs 64 bits. */
+static inline fixed_t fp_div (fixed_t x, fixed_t y) {
+  return ((int64_t) x) * FP_F / y;
+}
+
+/* Returns X / N. */
+static inline fixed_t fp_div_int (fixed_t x, int n) {
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -0,0 +1,229 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor Coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR0_NE 0x00000020       /* Numeric Error. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE/FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SSE exceptions raise #XF. */
+
+/* CPUID leaf 1 EDX bits. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* SSE. */
+#define CPUID_SSE2 (1u << 26)   /* SSE2. */
+
+/* True if the CPU supports FXSAVE, and thus user programs may
+   use x87, MMX and, if present, SSE instructions.  If false, the
+   FPU stays disabled and any FPU instruction kills the
+   process. */
+bool fpu_enabled;
+
+/* True if the kernel may use SSE2 for large copies. */
+static bool fpu_sse2;
+
+/* FPU state of a thread that has just started using the FPU. */
+static struct fpu_state initial_state __attribute__ ((aligned (16)));
+
+/* Allocates struct fpu_state, which must be 16-byte aligned. */
+static struct kmem_cache fpu_cache;
+
+/* Interrupt level to restore at string_sse2_end(). */
+static enum intr_level sse2_level;
+
+static inline uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+/* Sets CR0.TS, so that the next FPU instruction raises #NM. */
+static inline void
+stts (void)
+{
+  write_cr0 (read_cr0 () | CR0_TS);
+}
+
+/* Clears CR0.TS, so that FPU instructions run normally. */
+static inline void
+clts (void)
+{
+  asm volatile ("clts");
+}
+
+static inline void
+fxsave (struct fpu_state *s)
+{
+  asm volatile ("fxsave %0" : "=m" (*s));
+}
+
+static inline void
+fxrstor (const struct fpu_state *s)
+{
+  asm volatile ("fxrstor %0" : : "m" (*s));
+}
+
+/* Turns on the FPU if the CPU supports FXSAVE and records the
+   state that threads start with. */
+void
+fpu_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  uint32_t cr4;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  if (!(edx & CPUID_FXSR))
+    {
+      printf ("FPU: no FXSAVE support, floating point disabled.\n");
+      return;
+    }
+
+  write_cr0 ((read_cr0 () & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_OSFXSR;
+  if (edx & CPUID_SSE)
+    cr4 |= CR4_OSXMMEXCPT;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
+  /* Reset the x87 unit and set MXCSR to its reset value, which
+     masks all SSE exceptions. */
+  asm volatile ("fninit");
+  if (edx & CPUID_SSE)
+    {
+      uint32_t mxcsr = 0x1f80;
+      asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+  fxsave (&initial_state);
+  stts ();
+
+  kmem_cache_create (&fpu_cache, "fpu", sizeof (struct fpu_state), NULL);
+  fpu_enabled = true;
+  fpu_sse2 = (edx & CPUID_SSE2) != 0;
+}
+
+/* Called on every context switch, with interrupts off, to make
+   the FPU trap unless the new thread owns it. */
+void
+fpu_switch (void)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!fpu_enabled)
+    return;
+  if (cpu_current ()->fpu_owner == cur)
+    clts ();
+  else
+    stts ();
+}
+
+/* Handles #NM for the running thread: makes its FPU state the
+   live one on this CPU.  Returns false if memory for the state
+   cannot be allocated. */
+bool
+fpu_claim (void)
+{
+  struct thread *cur = thread_current ();
+  struct cpu *c;
+  enum intr_level old_level;
+
+  if (!fpu_enabled)
+    return false;
+
+  /* Allocate state on first use, before disabling interrupts,
+     since allocation may sleep. */
+  if (cur->fpu == NULL)
+    {
+      struct fpu_state *s = kmem_cache_alloc (&fpu_cache);
+      if (s == NULL)
+        return false;
+      memcpy (s, &initial_state, sizeof *s);
+      cur->fpu = s;
+    }
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  clts ();
+  if (c->fpu_owner != cur)
+    {
+      if (c->fpu_owner != NULL)
+        fxsave (c->fpu_owner->fpu);
+      fxrstor (cur->fpu);
+      c->fpu_owner = cur;
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Releases the running thread's FPU state.  Called as it
+   exits. */
+void
+fpu_exit (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (cur->fpu == NULL)
+    return;
+
+  old_level = intr_disable ();
+  if (cpu_current ()->fpu_owner == cur)
+    {
+      cpu_current ()->fpu_owner = NULL;
+      stts ();
+    }
+  intr_set_level (old_level);
+
+  kmem_cache_free (&fpu_cache, cur->fpu);
+  cur->fpu = NULL;
+}
+
+/* Lets lib/string.c use the XMM registers for a large copy:
+   saves the user state they hold, if any, and leaves the FPU
+   usable with interrupts off until string_sse2_end(). */
+bool
+string_sse2_begin (void)
+{
+  enum intr_level old_level;
+  struct cpu *c;
+
+  if (!fpu_sse2 || intr_context ())
+    return false;
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  clts ();
+  if (c->fpu_owner != NULL)
+    {
+      fxsave (c->fpu_owner->fpu);
+      c->fpu_owner = NULL;
+    }
+  sse2_level = old_level;
+  return true;
+}
+
+/* Ends a copy started with string_sse2_begin(). */
+void
+string_sse2_end (void)
+{
+  stts ();
+  intr_set_level (sse2_level);
+}
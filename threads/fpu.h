@@ -0,0 +1,40 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Lazy x87/SSE state switching.
+
+   Most threads never touch the floating-point unit, so we do not
+   save and restore its registers on every context switch.
+   Instead, each CPU remembers the thread whose state its FPU
+   holds, its "FPU owner".  Switching to any other thread sets
+   CR0.TS, so that the thread's first FPU or SSE instruction
+   raises #NM.  The #NM handler saves the owner's state, loads the
+   faulting thread's state, allocating and initializing it on
+   first use, and makes that thread the owner.
+
+   A thread's state stays in its CPU's registers until another
+   thread claims the FPU there.  Threads therefore must not move
+   to another CPU while they own an FPU.  This holds as long as
+   only the boot CPU runs threads. */
+
+/* FXSAVE area.  Must be 16-byte aligned. */
+struct fpu_state
+  {
+    uint8_t data[512];
+  };
+
+extern bool fpu_enabled;
+
+void fpu_init (void);
+void fpu_switch (void);
+bool fpu_claim (void);
+void fpu_exit (void);
+
+/* For lib/string.c. */
+bool string_sse2_begin (void);
+void string_sse2_end (void);
+
+#endif /* threads/fpu.h */
@@ -15,13 +15,17 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -36,6 +40,7 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -98,6 +103,7 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  fpu_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -116,7 +122,11 @@ main (void)
 #endif
 
   /* Start thread scheduler and enable interrupts. */
+  trace_init ();
+  profile_init ();
   thread_start ();
+  work_queue_init ();
+  palloc_zero_init ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -132,8 +142,10 @@ main (void)
   /* Run actions specified on kernel command line. */
   run_actions (argv);
 
+#ifdef FILESYS
   /* Free filesys_lock*/
   free(filesys_lock);
+#endif
 
   /* Finish up. */
   shutdown ();
@@ -250,6 +262,8 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-prealloc"))
+        inode_prealloc = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -259,6 +273,12 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-notickless"))
+        timer_tickless = false;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-profile"))
+        profile_hz = value != NULL ? atoi (value) : 0;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -376,12 +396,16 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -prealloc          Allocate, not skip, sectors written past end of file.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -notickless        Keep the timer ticking while idle.\n"
+          "  -trace             Trace scheduling, dump it at shutdown.\n"
+          "  -profile[=HZ]      Sample kernel stacks per tick or at HZ via RTC.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
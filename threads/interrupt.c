@@ -7,6 +7,7 @@
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 
@@ -214,6 +215,28 @@ intr_context (void)
   return in_external_intr;
 }
 
+/* Returns true if external interrupt VEC_NO has been raised but
+   not yet delivered to the CPU, for example because interrupts
+   are off.  Reads the PIC's interrupt request register. */
+bool
+intr_ext_pending (uint8_t vec_no) 
+{
+  int irq = vec_no - 0x20;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  if (irq < 8)
+    {
+      outb (PIC0_CTRL, 0x0a); /* OCW3: read IRR. */
+      return (inb (PIC0_CTRL) >> irq) & 1;
+    }
+  else
+    {
+      outb (PIC1_CTRL, 0x0a); /* OCW3: read IRR. */
+      return (inb (PIC1_CTRL) >> (irq - 8)) & 1;
+    }
+}
+
 /* During processing of an external interrupt, directs the
    interrupt handler to yield to a new process just before
    returning from the interrupt.  May not be called at any other
@@ -359,8 +382,15 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+
+      /* If the CPU was idling without timer ticks, bring the
+         clock up to date before the handler looks at it. */
+      if (frame->vec_no != 0x20)
+        timer_idle_exit ();
     }
 
+  trace (TRACE_INTR_ENTER, thread_current ()->tid, frame->vec_no);
+
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
@@ -374,6 +404,8 @@ intr_handler (struct intr_frame *frame)
   else
     unexpected_interrupt (frame);
 
+  trace (TRACE_INTR_EXIT, thread_current ()->tid, frame->vec_no);
+
   /* Complete the processing of an external interrupt. */
   if (external) 
     {
@@ -0,0 +1,127 @@
+#include "threads/lockstat.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "threads/interrupt.h"
+
+#ifdef LOCKSTAT
+
+/* Maximum number of distinct lock names.  Locks beyond that are
+   lumped together.  A fixed table, rather than malloc(), lets
+   the allocators' own locks be profiled too. */
+#define LOCKSTAT_MAX 64
+
+static struct lockstat_class classes[LOCKSTAT_MAX];
+static int class_cnt;
+static struct lockstat_class overflow_class = { "(other)", 0, 0, 0, 0, 0, 0 };
+
+static int compare_wait (const void *, const void *);
+
+/* Returns the statistics for locks named NAME, creating them if
+   this is the first such lock.  A null NAME stands for locks
+   without a name. */
+struct lockstat_class *
+lockstat_class (const char *name)
+{
+  struct lockstat_class *c = NULL;
+  enum intr_level old_level;
+  int i;
+
+  if (name == NULL)
+    name = "(unnamed)";
+
+  old_level = intr_disable ();
+  for (i = 0; i < class_cnt; i++)
+    if (classes[i].name == name || !strcmp (classes[i].name, name))
+      {
+        c = &classes[i];
+        break;
+      }
+  if (c == NULL)
+    {
+      if (class_cnt < LOCKSTAT_MAX)
+        {
+          c = &classes[class_cnt++];
+          c->name = name;
+        }
+      else
+        c = &overflow_class;
+    }
+  intr_set_level (old_level);
+
+  return c;
+}
+
+/* Records an acquisition of a lock in class C, which waited
+   WAIT cycles for it if CONTENDED.  Interrupts must be off. */
+void
+lockstat_acquired (struct lockstat_class *c, bool contended, uint64_t wait)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->acquisitions++;
+  if (contended)
+    {
+      c->contended++;
+      c->wait_total += wait;
+      if (wait > c->wait_max)
+        c->wait_max = wait;
+    }
+}
+
+/* Records a release of a lock in class C after holding it for
+   HOLD cycles.  Interrupts must be off. */
+void
+lockstat_released (struct lockstat_class *c, uint64_t hold)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->hold_total += hold;
+  if (hold > c->hold_max)
+    c->hold_max = hold;
+}
+
+/* Prints the statistics for every lock name that was acquired
+   at least once, the most waited-for first. */
+void
+lockstat_print_stats (void)
+{
+  struct lockstat_class *sorted[LOCKSTAT_MAX + 1];
+  int cnt = 0;
+  int i;
+
+  for (i = 0; i < class_cnt; i++)
+    if (classes[i].acquisitions > 0)
+      sorted[cnt++] = &classes[i];
+  if (overflow_class.acquisitions > 0)
+    sorted[cnt++] = &overflow_class;
+  qsort (sorted, cnt, sizeof *sorted, compare_wait);
+
+  printf ("Lockstat: %-20s %10s %10s %14s %12s %14s %12s\n", "name",
+          "acquired", "contended", "wait-cycles", "wait-max",
+          "hold-cycles", "hold-max");
+  for (i = 0; i < cnt; i++)
+    {
+      struct lockstat_class *c = sorted[i];
+      printf ("Lockstat: %-20.20s %10lld %10lld %14llu %12llu %14llu %12llu\n",
+              c->name, c->acquisitions, c->contended,
+              (unsigned long long) c->wait_total,
+              (unsigned long long) c->wait_max,
+              (unsigned long long) c->hold_total,
+              (unsigned long long) c->hold_max);
+    }
+}
+
+/* qsort() comparison function that orders lock classes by
+   descending total wait time. */
+static int
+compare_wait (const void *a_, const void *b_)
+{
+  const struct lockstat_class *a = *(struct lockstat_class *const *) a_;
+  const struct lockstat_class *b = *(struct lockstat_class *const *) b_;
+
+  return (a->wait_total < b->wait_total) - (a->wait_total > b->wait_total);
+}
+
+#endif /* LOCKSTAT */
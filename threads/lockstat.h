@@ -0,0 +1,36 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Lock contention statistics.
+
+   Compiled in only when the kernel is built with LOCKSTAT
+   defined, e.g. with "make LOCKSTAT=1"; otherwise locks carry no
+   extra state and lock operations do no extra work.
+
+   Statistics are kept per lock name rather than per lock, so
+   that, for example, all the inode locks add up into one line of
+   the report.  lock_init() names each lock after the expression
+   passed to it, and lock_init_named() sets the name explicitly.
+   Times are in CPU cycles, as read from the time-stamp
+   counter. */
+struct lockstat_class
+  {
+    const char *name;           /* Lock name. */
+    long long acquisitions;     /* # of times acquired. */
+    long long contended;        /* # of those that had to wait. */
+    uint64_t wait_total;        /* Cycles spent waiting. */
+    uint64_t wait_max;          /* Longest single wait. */
+    uint64_t hold_total;        /* Cycles held. */
+    uint64_t hold_max;          /* Longest single hold. */
+  };
+
+struct lockstat_class *lockstat_class (const char *name);
+void lockstat_acquired (struct lockstat_class *, bool contended,
+                        uint64_t wait);
+void lockstat_released (struct lockstat_class *, uint64_t hold);
+void lockstat_print_stats (void);
+
+#endif /* threads/lockstat.h */
@@ -6,8 +6,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* A simple implementation of malloc().
 
@@ -32,7 +34,24 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of each descriptor's free list sits a magazine of
+   free blocks, the same as in front of an object cache's slabs
+   (see threads/slab.h), so that most requests are satisfied
+   without taking the descriptor's lock.  Blocks in a magazine
+   still count as in use in their arenas.
+
+   An arena that becomes entirely unused is not given back to
+   the page allocator right away, because the next malloc() would
+   likely have to get it back.  Instead, it goes into its
+   descriptor's "depot" of empty arenas, and once the depot holds
+   more than DEPOT_MAX of them, a work item trims it back to
+   DEPOT_KEEP. */
+
+/* Empty arenas kept per descriptor after and before trimming. */
+#define DEPOT_MAX 4
+#define DEPOT_KEEP 1
 
 /* Descriptor. */
 struct desc
@@ -40,7 +59,10 @@ struct desc
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
+    struct list depot;          /* Entirely unused arenas. */
+    size_t depot_cnt;           /* Number of arenas in DEPOT. */
     struct lock lock;           /* Lock. */
+    struct kmem_magazine mag;   /* Free blocks before FREE_LIST. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -52,6 +74,7 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct list_elem depot_elem; /* Element in desc's `depot', if empty. */
   };
 
 /* Free block. */
@@ -64,8 +87,14 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Trims the descriptors' depots. */
+static struct work trim_work;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static kmem_get_func desc_get;
+static kmem_put_func desc_put;
+static void trim_depots (struct work *, void *aux);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -80,8 +109,12 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
+      list_init (&d->depot);
+      d->depot_cnt = 0;
       lock_init (&d->lock);
+      kmem_magazine_init (&d->mag, &d->lock, desc_get, desc_put, d);
     }
+  work_init (&trim_work, trim_depots, NULL);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -90,7 +123,6 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
-  struct block *b;
   struct arena *a;
 
   /* A null pointer satisfies a request for 0 bytes. */
@@ -119,7 +151,18 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
+  return kmem_magazine_get (&d->mag);
+}
+
+/* Takes a block from descriptor D_'s free list, creating a new
+   arena if the list is empty.  Returns a null pointer if memory
+   is not available.  D_'s lock must be held. */
+static void *
+desc_get (void *d_)
+{
+  struct desc *d = d_;
+  struct block *b;
+  struct arena *a;
 
   /* If the free list is empty, create a new arena. */
   if (list_empty (&d->free_list))
@@ -129,10 +172,7 @@ malloc (size_t size)
       /* Allocate a page. */
       a = palloc_get_page (0);
       if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
+        return NULL; 
 
       /* Initialize arena and add its blocks to the free list. */
       a->magic = ARENA_MAGIC;
@@ -143,13 +183,18 @@ malloc (size_t size)
           struct block *b = arena_to_block (a, i);
           list_push_back (&d->free_list, &b->free_elem);
         }
+      list_push_back (&d->depot, &a->depot_elem);
+      d->depot_cnt++;
     }
 
-  /* Get a block from free list and return it. */
+  /* Get a block from free list. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  if (a->free_cnt-- == d->blocks_per_arena)
+    {
+      list_remove (&a->depot_elem);
+      d->depot_cnt--;
+    }
   return b;
 }
 
@@ -232,27 +277,8 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
-
-          lock_release (&d->lock);
+          kmem_magazine_put (&d->mag, b);
         }
       else
         {
@@ -263,6 +289,63 @@ free (void *p)
     }
 }
 
+/* Returns block B_ to descriptor D_'s free list.  If that leaves
+   its arena entirely unused, moves the arena to D_'s depot, and
+   trims the depots if this one has grown too large.  D_'s lock
+   must be held. */
+static void
+desc_put (void *d_, void *b_)
+{
+  struct desc *d = d_;
+  struct block *b = b_;
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (a->desc == d);
+
+  list_push_front (&d->free_list, &b->free_elem);
+  if (++a->free_cnt >= d->blocks_per_arena)
+    {
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      list_push_front (&d->depot, &a->depot_elem);
+      d->depot_cnt++;
+
+      /* Before the work queues are up, nothing frees enough
+         memory to matter, so just let the depot grow. */
+      if (d->depot_cnt > DEPOT_MAX && system_wq.workers > 0)
+        work_queue_submit (&system_wq, &trim_work);
+    }
+}
+
+/* Gives all but DEPOT_KEEP of each descriptor's empty arenas back
+   to the page allocator.  Runs in a system work queue worker. */
+static void
+trim_depots (struct work *w UNUSED, void *aux UNUSED)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      lock_acquire (&d->lock);
+      while (d->depot_cnt > DEPOT_KEEP)
+        {
+          /* The depot is in order of most recent use, so free the
+             arenas that have been empty the longest. */
+          struct arena *a = list_entry (list_pop_back (&d->depot),
+                                        struct arena, depot_elem);
+          size_t i;
+
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_remove (&b->free_elem);
+            }
+          d->depot_cnt--;
+          palloc_free_page (a);
+        }
+      lock_release (&d->lock);
+    }
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
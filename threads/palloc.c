@@ -1,6 +1,6 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
+#include <list.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stddef.h>
@@ -9,7 +9,9 @@
 #include <string.h>
 #include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,22 +25,75 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept in
+   blocks of 2**ORDER pages, aligned to their size relative to
+   the pool base, on one free list per order.  An allocation of N
+   pages takes a block of the smallest order that holds N pages,
+   splitting a larger block if need be, and gives the unused tail
+   back.  Freeing a block merges it with its "buddy", the other
+   half of the block of the next order up, for as long as that
+   buddy is free too.  Both take time logarithmic in the size of
+   the pool, rather than linear as a bitmap scan would.
+
+   Any run of allocated pages may be freed, not just a whole
+   allocation: the run is freed as the largest aligned blocks
+   that make it up.
+
+   Zeroing a page on the spot makes PAL_ZERO allocations, such as
+   page tables and new user stacks, slow.  So each pool also keeps
+   up to ZEROED_PAGES pages that were zeroed ahead of time by a
+   work queue thread at the lowest priority, which runs only when
+   the CPU would otherwise be idle.  Single-page PAL_ZERO
+   allocations are served from them first.  They are given back
+   if an allocation would otherwise fail. */
+
+/* Number of pre-zeroed pages to keep in each pool. */
+#define ZEROED_PAGES 32
+
+/* Orders 0 through MAX_ORDER, so blocks of up to 2**MAX_ORDER
+   pages, or 4 GB. */
+#define MAX_ORDER 20
+
+/* Per-page state.  Only the first page of a free block is marked
+   free and records the block's order. */
+struct page_info
+  {
+    uint8_t order;                      /* Order of free block. */
+    bool free;                          /* First page of a free block? */
+  };
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct page_info *pages;            /* Per-page state. */
+    struct list free[MAX_ORDER + 1];    /* Free blocks of each order. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    struct list zeroed;                 /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
+    long long zero_hits;                /* PAL_ZERO served pre-zeroed. */
+    long long zero_misses;              /* PAL_ZERO zeroed on the spot. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Work queue and item that refill the pre-zeroed pages. */
+static struct work_queue zero_wq;
+static struct work zero_work;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_block (struct pool *, int order);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void *get_zeroed (struct pool *);
+static bool release_zeroed (struct pool *);
+static void refill_zeroed (struct work *, void *aux);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -61,6 +116,16 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
+/* Starts keeping pre-zeroed pages.  Must be called after
+   work_queue_init(). */
+void
+palloc_zero_init (void)
+{
+  work_queue_create (&zero_wq, "zero", 1, PRI_MIN);
+  work_init (&zero_work, refill_zeroed, NULL);
+  work_queue_submit (&zero_wq, &zero_work);
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -72,16 +137,37 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
-  size_t page_idx;
+  size_t page_idx = SIZE_MAX;
+  int order;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if ((flags & PAL_ZERO) && page_cnt == 1)
+    {
+      pages = get_zeroed (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
+  /* Find the smallest order that holds PAGE_CNT pages. */
+  for (order = 0; order <= MAX_ORDER && ((size_t) 1 << order) < page_cnt;
+       order++)
+    continue;
+
+  if (order <= MAX_ORDER)
+    {
+      lock_acquire (&pool->lock);
+      page_idx = alloc_block (pool, order);
+      if (page_idx == SIZE_MAX && release_zeroed (pool))
+        page_idx = alloc_block (pool, order);
+      if (page_idx != SIZE_MAX)
+        free_range (pool, page_idx + page_cnt,
+                    ((size_t) 1 << order) - page_cnt);
+      lock_release (&pool->lock);
+    }
 
-  if (page_idx != BITMAP_ERROR)
+  if (page_idx != SIZE_MAX)
     pages = pool->base + PGSIZE * page_idx;
   else
     pages = NULL;
@@ -89,7 +175,11 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          if (page_cnt == 1)
+            pool->zero_misses++;
+        }
     }
   else 
     {
@@ -132,13 +222,15 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  lock_acquire (&pool->lock);
+  free_range (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +240,44 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Prints statistics on pre-zeroed pages. */
+void
+palloc_print_stats (void)
+{
+  printf ("Palloc: %lld pre-zeroed page hits, %lld misses\n",
+          kernel_pool.zero_hits + user_pool.zero_hits,
+          kernel_pool.zero_misses + user_pool.zero_misses);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's page_info array at its base.
+     Calculate the space needed for the array
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t info_pages = DIV_ROUND_UP (page_cnt * sizeof *p->pages, PGSIZE);
+  int order;
+
+  if (info_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page map.", name);
+  page_cnt -= info_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  lock_init_named (&p->lock, name);
+  p->pages = base;
+  memset (p->pages, 0, page_cnt * sizeof *p->pages);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free[order]);
+  p->base = base + info_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  free_range (p, 0, page_cnt);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->zero_hits = p->zero_misses = 0;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +287,177 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the list element stored in free page PAGE_IDX of
+   POOL. */
+static struct list_elem *
+page_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+   larger block if necessary, and returns the index of its first
+   page, or SIZE_MAX if there is no such block.  POOL's lock must
+   be held. */
+static size_t
+alloc_block (struct pool *pool, int order)
+{
+  size_t page_idx;
+  int k;
+
+  for (k = order; k <= MAX_ORDER && list_empty (&pool->free[k]); k++)
+    continue;
+  if (k > MAX_ORDER)
+    return SIZE_MAX;
+
+  page_idx = pg_no (list_pop_front (&pool->free[k])) - pg_no (pool->base);
+  ASSERT (pool->pages[page_idx].free);
+  ASSERT (pool->pages[page_idx].order == k);
+  pool->pages[page_idx].free = false;
+
+  /* Give back the upper half of the block until it is the
+     requested size. */
+  while (k > order)
+    {
+      size_t buddy;
+
+      k--;
+      buddy = page_idx + ((size_t) 1 << k);
+      pool->pages[buddy].free = true;
+      pool->pages[buddy].order = k;
+      list_push_front (&pool->free[k], page_elem (pool, buddy));
+    }
+  return page_idx;
+}
+
+/* Frees the block of 2**ORDER pages starting at PAGE_IDX in
+   POOL, merging it with its buddies.  POOL's lock must be
+   held. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (page_idx % ((size_t) 1 << order) == 0);
+  ASSERT (!pool->pages[page_idx].free);
+
+  while (order < MAX_ORDER)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || !pool->pages[buddy].free
+          || pool->pages[buddy].order != order)
+        break;
+
+      list_remove (page_elem (pool, buddy));
+      pool->pages[buddy].free = false;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  pool->pages[page_idx].free = true;
+  pool->pages[page_idx].order = order;
+  list_push_front (&pool->free[order], page_elem (pool, page_idx));
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that make them up.  POOL's lock must be
+   held, except during initialization. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes a pre-zeroed page from POOL and returns it, or returns a
+   null pointer if there is none. */
+static void *
+get_zeroed (struct pool *pool)
+{
+  struct list_elem *e = NULL;
+
+  lock_acquire (&pool->lock);
+  if (!list_empty (&pool->zeroed))
+    {
+      e = list_pop_front (&pool->zeroed);
+      pool->zeroed_cnt--;
+      pool->zero_hits++;
+    }
+  lock_release (&pool->lock);
+
+  if (e == NULL)
+    return NULL;
+
+  /* The list element was the only part of the page in use. */
+  memset (e, 0, sizeof *e);
+  if (zero_wq.workers > 0)
+    work_queue_submit (&zero_wq, &zero_work);
+  return e;
+}
+
+/* Gives POOL's pre-zeroed pages back to its free lists.  Returns
+   true if there were any.  POOL's lock must be held. */
+static bool
+release_zeroed (struct pool *pool)
+{
+  if (list_empty (&pool->zeroed))
+    return false;
+
+  while (!list_empty (&pool->zeroed))
+    {
+      void *page = list_pop_front (&pool->zeroed);
+      free_range (pool, pg_no (page) - pg_no (pool->base), 1);
+    }
+  pool->zeroed_cnt = 0;
+  return true;
+}
+
+/* Tops up each pool's pre-zeroed pages.  Runs in the zero work
+   queue's worker, at the lowest priority. */
+static void
+refill_zeroed (struct work *w UNUSED, void *aux UNUSED)
+{
+  struct pool *pools[] = { &kernel_pool, &user_pool };
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+
+      for (;;)
+        {
+          size_t page_idx = SIZE_MAX;
+          void *page;
+
+          lock_acquire (&pool->lock);
+          if (pool->zeroed_cnt < ZEROED_PAGES)
+            page_idx = alloc_block (pool, 0);
+          lock_release (&pool->lock);
+          if (page_idx == SIZE_MAX)
+            break;
+
+          page = pool->base + PGSIZE * page_idx;
+          memset (page, 0, PGSIZE);
+
+          lock_acquire (&pool->lock);
+          list_push_back (&pool->zeroed, page);
+          pool->zeroed_cnt++;
+          lock_release (&pool->lock);
+        }
+    }
+}
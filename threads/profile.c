@@ -0,0 +1,141 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/rtc.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Number of distinct stacks the histogram can hold.  A power of
+   2.  Samples of further stacks are only counted as dropped. */
+#define PROFILE_BUCKETS 1024
+
+/* Number of buckets probed before a sample is dropped. */
+#define PROFILE_PROBES 16
+
+/* A histogram bucket: one distinct stack and its sample count. */
+struct profile_bucket
+  {
+    uintptr_t pcs[PROFILE_DEPTH];       /* PCs, innermost first. */
+    uint32_t count;                     /* # of samples; 0 if unused. */
+    uint8_t depth;                      /* # of valid PCS. */
+    bool user;                          /* Sampled in user mode? */
+  };
+
+/* Sampling rate requested with "-profile=HZ", or 0 to sample
+   on every timer tick.  -1 if the profiler is off. */
+int profile_hz = -1;
+
+/* True while timer_interrupt() should take samples. */
+bool profile_on_tick;
+
+static struct profile_bucket *buckets;
+static long long samples;               /* Samples taken. */
+static long long dropped;               /* Samples that did not fit. */
+static int actual_hz;                   /* Sampling rate in effect. */
+
+/* Starts the profiler, if the "-profile" option was given.  Must
+   be called after the interrupt handlers are set up. */
+void
+profile_init (void)
+{
+  size_t pages = DIV_ROUND_UP (PROFILE_BUCKETS * sizeof *buckets, PGSIZE);
+
+  if (profile_hz < 0)
+    return;
+
+  buckets = palloc_get_multiple (PAL_ZERO | PAL_ASSERT, pages);
+  if (profile_hz > 0)
+    actual_hz = rtc_periodic_start (profile_hz, profile_sample);
+  else
+    {
+      actual_hz = TIMER_FREQ;
+      profile_on_tick = true;
+    }
+}
+
+/* Records one sample of the code that interrupt frame F
+   interrupted.  Called from an interrupt handler. */
+void
+profile_sample (struct intr_frame *f)
+{
+  uintptr_t pcs[PROFILE_DEPTH];
+  bool user = (f->cs & 3) == 3;
+  int depth = 0;
+  unsigned h;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  pcs[depth++] = (uintptr_t) f->eip;
+  if (!user)
+    {
+      /* Walk the frame pointers of the interrupted kernel code.
+         All of its frames lie in the current thread's stack page,
+         at increasing addresses, so stop at anything else. */
+      uintptr_t page = (uintptr_t) pg_round_down (f);
+      uintptr_t *frame = (uintptr_t *) f->ebp;
+
+      while (depth < PROFILE_DEPTH
+             && (uintptr_t) frame >= page
+             && (uintptr_t) frame + 2 * sizeof *frame <= page + PGSIZE
+             && frame[1] != 0)
+        {
+          uintptr_t *next = (uintptr_t *) frame[0];
+          pcs[depth++] = frame[1];
+          if (next <= frame)
+            break;
+          frame = next;
+        }
+    }
+
+  samples++;
+  h = hash_bytes (pcs, depth * sizeof *pcs) ^ user;
+  for (i = 0; i < PROFILE_PROBES; i++)
+    {
+      struct profile_bucket *b = &buckets[(h + i) % PROFILE_BUCKETS];
+      if (b->count == 0)
+        {
+          memcpy (b->pcs, pcs, depth * sizeof *pcs);
+          b->depth = depth;
+          b->user = user;
+        }
+      else if (b->depth != depth || b->user != user
+               || memcmp (b->pcs, pcs, depth * sizeof *pcs))
+        continue;
+      b->count++;
+      return;
+    }
+  dropped++;
+}
+
+/* Prints the histogram as folded stacks: each line holds a
+   stack's PCs, outermost first and separated by semicolons, then
+   its sample count.  User-mode samples are rooted at "user". */
+void
+profile_print_stats (void)
+{
+  int i, j;
+
+  if (buckets == NULL)
+    return;
+
+  printf ("PROFILE: begin %lld samples %lld dropped %d Hz\n",
+          samples, dropped, actual_hz);
+  for (i = 0; i < PROFILE_BUCKETS; i++)
+    {
+      struct profile_bucket *b = &buckets[i];
+      if (b->count == 0)
+        continue;
+      printf ("PROFILE: %s", b->user ? "user;" : "");
+      for (j = b->depth - 1; j >= 0; j--)
+        printf ("%#x%s", b->pcs[j], j > 0 ? ";" : "");
+      printf (" %"PRIu32"\n", b->count);
+    }
+  printf ("PROFILE: end\n");
+}
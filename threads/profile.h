@@ -0,0 +1,29 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* Statistical sampling profiler.
+
+   With the kernel command-line option "-profile", each timer
+   tick samples the code it interrupted: the program counter
+   and, in kernel mode, up to PROFILE_DEPTH - 1 callers found by
+   walking the frame-pointer chain.  "-profile=HZ" samples from
+   the RTC's periodic interrupt instead, at HZ rounded down to a
+   power of 2 between 2 and 8192.
+
+   Identical stacks are counted together in a hash table, which
+   is printed at shutdown as folded stacks, one per line, root
+   first.  "backtrace --folded" symbolizes them into the input
+   format of flame graph tools. */
+#define PROFILE_DEPTH 8
+
+extern int profile_hz;
+extern bool profile_on_tick;
+
+void profile_init (void);
+void profile_sample (struct intr_frame *);
+void profile_print_stats (void);
+
+#endif /* threads/profile.h */
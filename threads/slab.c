@@ -0,0 +1,291 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A slab is one page: this header at the start and the objects
+   packed against the end, so that objects whose size is a
+   multiple of 2**N are 2**N-byte aligned.  The free objects are
+   tracked in a bitmap rather than in a list threaded through the
+   objects, so that a free object keeps the state its constructor
+   gave it. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Smallest object size, which bounds the number of objects per
+   slab and thus the size of the bitmap. */
+#define MIN_OBJ_SIZE 8
+#define MAX_OBJS (PGSIZE / MIN_OBJ_SIZE)
+
+struct slab
+  {
+    unsigned magic;                     /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;           /* Owning cache. */
+    struct list_elem elem;              /* Element in cache's `partial'. */
+    size_t free_cnt;                    /* # of free objects. */
+    uint32_t free_map[MAX_OBJS / 32];   /* Bit set for each free object. */
+  };
+
+/* All caches, for statistics. */
+static struct list caches = LIST_INITIALIZER (caches);
+
+static kmem_get_func slab_get;
+static kmem_put_func slab_put;
+
+/* Initializes cache C to hand out objects of SIZE bytes, named
+   NAME.  If CTOR is nonnull, it is called on each object when
+   its slab is created.  Does not allocate memory, so may be
+   called before the page allocator is initialized. */
+void
+kmem_cache_create (struct kmem_cache *c, const char *name, size_t size,
+                   kmem_ctor_func *ctor)
+{
+  ASSERT (c != NULL);
+  ASSERT (size > 0 && size <= PGSIZE - sizeof (struct slab));
+
+  c->name = name;
+  c->size = ROUND_UP (size < MIN_OBJ_SIZE ? MIN_OBJ_SIZE : size,
+                      sizeof (void *));
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->size;
+  c->ctor = ctor;
+  lock_init_named (&c->lock, name);
+  list_init (&c->partial);
+  c->slabs = 0;
+  kmem_magazine_init (&c->mag, &c->lock, slab_get, slab_put, c);
+  list_push_back (&caches, &c->elem);
+}
+
+/* Obtains and returns a free object from cache C, or a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  return kmem_magazine_get (&c->mag);
+}
+
+/* Returns OBJ, which must have been obtained from cache C and be
+   in its constructed state, to C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  ASSERT (obj != NULL);
+  kmem_magazine_put (&c->mag, obj);
+}
+
+/* Initializes magazine M, empty, in front of a store of free
+   objects protected by LOCK.  GET takes an object out of the
+   store, or returns a null pointer if it has none and cannot get
+   more, and PUT returns one to it.  Both are passed AUX and are
+   called with LOCK held. */
+void
+kmem_magazine_init (struct kmem_magazine *m, struct lock *lock,
+                    kmem_get_func *get, kmem_put_func *put, void *aux)
+{
+  m->rounds = 0;
+  m->allocated = 0;
+  m->lock = lock;
+  m->get = get;
+  m->put = put;
+  m->aux = aux;
+}
+
+/* Obtains and returns a free object from magazine M, or a null
+   pointer if M and its store are both empty. */
+void *
+kmem_magazine_get (struct kmem_magazine *m)
+{
+  void *batch[KMEM_MAGAZINE_SIZE / 2];
+  enum intr_level old_level;
+  void *obj;
+  int n;
+
+  old_level = intr_disable ();
+  if (m->rounds > 0)
+    {
+      obj = m->objs[--m->rounds];
+      m->allocated++;
+      intr_set_level (old_level);
+      return obj;
+    }
+  intr_set_level (old_level);
+
+  /* The magazine is empty.  Refill half of it from the store. */
+  lock_acquire (m->lock);
+  for (n = 0; n < KMEM_MAGAZINE_SIZE / 2; n++)
+    {
+      batch[n] = m->get (m->aux);
+      if (batch[n] == NULL)
+        break;
+    }
+  if (n == 0)
+    {
+      lock_release (m->lock);
+      return NULL;
+    }
+
+  /* Keep one object for the caller.  Frees by other threads may
+     have refilled the magazine since we looked at it, so give
+     back whatever does not fit. */
+  obj = batch[--n];
+  old_level = intr_disable ();
+  m->allocated++;
+  while (n > 0 && m->rounds < KMEM_MAGAZINE_SIZE)
+    m->objs[m->rounds++] = batch[--n];
+  intr_set_level (old_level);
+  while (n > 0)
+    m->put (m->aux, batch[--n]);
+  lock_release (m->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from magazine M, to
+   M. */
+void
+kmem_magazine_put (struct kmem_magazine *m, void *obj)
+{
+  void *batch[KMEM_MAGAZINE_SIZE / 2];
+  enum intr_level old_level;
+  int n = 0;
+
+  old_level = intr_disable ();
+  if (m->rounds < KMEM_MAGAZINE_SIZE)
+    {
+      m->objs[m->rounds++] = obj;
+      m->allocated--;
+      intr_set_level (old_level);
+      return;
+    }
+  intr_set_level (old_level);
+
+  /* The magazine is full.  Drain half of it into the store, unless
+     allocations by other threads have emptied it meanwhile. */
+  lock_acquire (m->lock);
+  old_level = intr_disable ();
+  if (m->rounds == KMEM_MAGAZINE_SIZE)
+    while (n < KMEM_MAGAZINE_SIZE / 2)
+      batch[n++] = m->objs[--m->rounds];
+  m->objs[m->rounds++] = obj;
+  m->allocated--;
+  intr_set_level (old_level);
+  while (n > 0)
+    m->put (m->aux, batch[--n]);
+  lock_release (m->lock);
+}
+
+/* Prints the utilization of each cache: the objects handed out
+   against the capacity of its slabs. */
+void
+kmem_cache_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      size_t capacity = c->slabs * c->objs_per_slab;
+      long in_use = c->mag.allocated;
+
+      printf ("Slab: %s: %ld of %zu %zu-byte objects in use in %zu slabs "
+              "(%zu%% used)\n",
+              c->name, in_use, capacity, c->size, c->slabs,
+              capacity > 0 ? (size_t) in_use * 100 / capacity : 0);
+    }
+}
+
+/* Returns the offset of the first object within each of C's
+   slabs. */
+static size_t
+first_obj_ofs (const struct kmem_cache *c)
+{
+  return PGSIZE - c->objs_per_slab * c->size;
+}
+
+/* Returns the slab that OBJ is in. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT ((pg_ofs (obj) - first_obj_ofs (s->cache)) % s->cache->size == 0);
+  return s;
+}
+
+/* Returns the IDX'th object in slab S. */
+static void *
+slab_obj (struct slab *s, size_t idx)
+{
+  return (uint8_t *) s + first_obj_ofs (s->cache) + idx * s->cache->size;
+}
+
+/* Takes a free object out of cache C_'s slabs, creating a new
+   slab if none has one.  Returns a null pointer if memory is not
+   available.  C_'s lock must be held. */
+static void *
+slab_get (void *c_)
+{
+  struct kmem_cache *c = c_;
+  struct slab *s;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  if (list_empty (&c->partial))
+    {
+      s = palloc_get_page (0);
+      if (s == NULL)
+        return NULL;
+      s->magic = SLAB_MAGIC;
+      s->cache = c;
+      s->free_cnt = c->objs_per_slab;
+      memset (s->free_map, 0, sizeof s->free_map);
+      for (i = 0; i < c->objs_per_slab; i++)
+        {
+          s->free_map[i / 32] |= 1u << (i % 32);
+          if (c->ctor != NULL)
+            c->ctor (slab_obj (s, i));
+        }
+      list_push_front (&c->partial, &s->elem);
+      c->slabs++;
+    }
+
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  for (i = 0; s->free_map[i] == 0; i++)
+    continue;
+  i = i * 32 + __builtin_ctz (s->free_map[i]);
+  s->free_map[i / 32] &= ~(1u << (i % 32));
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+  return slab_obj (s, i);
+}
+
+/* Returns OBJ to its slab in cache C_, freeing the slab if it
+   becomes entirely unused.  C_'s lock must be held. */
+static void
+slab_put (void *c_, void *obj)
+{
+  struct kmem_cache *c = c_;
+  struct slab *s = obj_to_slab (obj);
+  size_t i = (pg_ofs (obj) - first_obj_ofs (c)) / c->size;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  ASSERT (s->cache == c);
+  ASSERT ((s->free_map[i / 32] & (1u << (i % 32))) == 0);
+
+  s->free_map[i / 32] |= 1u << (i % 32);
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->partial, &s->elem);
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      palloc_free_page (s);
+      c->slabs--;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches.
+
+   A cache hands out objects of a single type.  It carves them
+   out of page-sized "slabs" at their exact size, rather than
+   rounding them up to a power of 2 as malloc() does, so a
+   540-byte struct inode takes 540 bytes instead of 1 kB.
+
+   An optional constructor initializes each object once, when its
+   slab is created, not on every allocation.  Objects must
+   therefore be freed back to the cache in their constructed
+   state.
+
+   Each cache keeps a small "magazine" of free objects in front of
+   its slabs.  Allocations and frees are satisfied from it with
+   interrupts disabled and without taking the cache's lock, which
+   is taken only to refill or drain half a magazine at a time.
+   malloc() puts the same magazines in front of its free lists. */
+
+/* Number of objects a magazine holds. */
+#define KMEM_MAGAZINE_SIZE 16
+
+typedef void kmem_ctor_func (void *);
+
+/* Take an object from, or return OBJ to, the store behind a
+   magazine.  Called with the magazine's lock held. */
+typedef void *kmem_get_func (void *aux);
+typedef void kmem_put_func (void *aux, void *obj);
+
+/* A magazine of free objects. */
+struct kmem_magazine
+  {
+    /* Accessed with interrupts off. */
+    int rounds;                         /* # of objects in OBJS. */
+    void *objs[KMEM_MAGAZINE_SIZE];     /* Free objects, newest last. */
+    long allocated;                     /* # of objects in use. */
+
+    /* Store that refills and drains the magazine. */
+    struct lock *lock;                  /* Protects the store. */
+    kmem_get_func *get;                 /* Takes an object out. */
+    kmem_put_func *put;                 /* Puts an object back. */
+    void *aux;                          /* Argument to GET and PUT. */
+  };
+
+struct kmem_cache
+  {
+    const char *name;                   /* Name, for statistics. */
+    size_t size;                        /* Object size in bytes. */
+    size_t objs_per_slab;               /* Objects in one slab. */
+    kmem_ctor_func *ctor;               /* Constructor, or null. */
+    struct list_elem elem;              /* Element in list of all caches. */
+
+    struct lock lock;                   /* Protects the members below. */
+    struct list partial;                /* Slabs with free objects. */
+    size_t slabs;                       /* # of slabs. */
+
+    struct kmem_magazine mag;           /* Free objects before the slabs. */
+  };
+
+void kmem_cache_create (struct kmem_cache *, const char *name, size_t size,
+                        kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_print_stats (void);
+
+void kmem_magazine_init (struct kmem_magazine *, struct lock *,
+                         kmem_get_func *, kmem_put_func *, void *aux);
+void *kmem_magazine_get (struct kmem_magazine *);
+void kmem_magazine_put (struct kmem_magazine *, void *obj);
+
+#endif /* threads/slab.h */
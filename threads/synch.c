@@ -29,9 +29,19 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/lockstat.h"
 #include "threads/thread.h"
 
+/* Maximum number of lock holders a priority donation passes
+   through.  Bounds the time spent in lock_acquire() when locks
+   form long chains, or a cycle due to a deadlock. */
+#define DONATION_DEPTH_MAX 8
+
+static void donate_priority (struct thread *donor);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -75,6 +85,76 @@ sema_down (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
+/* State shared between sema_down_timeout() and its timer
+   callback. */
+struct sema_timeout
+  {
+    struct thread *thread;      /* Thread waiting on the semaphore. */
+    bool timed_out;             /* Set when the timer fired first. */
+  };
+
+/* Timer callback for sema_down_timeout().  Records the timeout
+   even if the waiter is not blocked, because sema_up() may have
+   readied it only for another thread to take the value before
+   it ran; it must then give up rather than block again with no
+   timer pending.  If the waiter is still blocked on the
+   semaphore, takes it off the wait list and wakes it up.  Runs
+   in the timer interrupt, so it is atomic with respect to
+   sema_up(). */
+static void
+sema_timeout_expire (struct timer_event *ev UNUSED, void *st_)
+{
+  struct sema_timeout *st = st_;
+
+  st->timed_out = true;
+  if (st->thread->status == THREAD_BLOCKED)
+    {
+      list_remove (&st->thread->elem);
+      thread_unblock (st->thread);
+    }
+}
+
+/* Down or "P" operation on a semaphore that gives up after
+   TICKS timer ticks.  Returns true if the semaphore was
+   decremented, false if the time limit expired first.  A
+   nonpositive TICKS is the same as sema_try_down().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks)
+{
+  struct sema_timeout st;
+  struct timer_event ev;
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  if (ticks <= 0)
+    return sema_try_down (sema);
+
+  st.thread = thread_current ();
+  st.timed_out = false;
+  timer_event_init (&ev, sema_timeout_expire, &st);
+
+  old_level = intr_disable ();
+  timer_event_add (&ev, ticks);
+  while (sema->value == 0 && !st.timed_out)
+    {
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  timer_event_cancel (&ev);
+  intr_set_level (old_level);
+
+  return success;
+}
+
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -101,8 +181,22 @@ sema_try_down (struct semaphore *sema)
   return success;
 }
 
+/* Returns true if thread A has a lower priority than thread B,
+   for use with list_max() on a list of waiting threads. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  Among threads of equal priority, the one that
+   has waited longest wins.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +208,15 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,19 +270,39 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   (The parentheses keep the LOCKSTAT version of lock_init() in
+   synch.h from expanding here.) */
+void
+(lock_init) (struct lock *lock)
+{
+  lock_init_named (lock, NULL);
+}
+
+/* Initializes LOCK, like lock_init(), giving it NAME in lock
+   contention reports.  NAME must remain valid as long as the
+   kernel runs.  It is ignored unless the kernel is built with
+   LOCKSTAT. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name UNUSED)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCKSTAT
+  lock->stat = lockstat_class (name);
+  lock->acquired = 0;
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
-   thread.
+   thread.  While waiting, the current thread donates its
+   priority to the holder, and on through any lock the holder is
+   itself waiting for.  (The 4.4BSD scheduler does not use
+   priority donation.)
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -192,12 +311,59 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCKSTAT
+  bool contended;
+  uint64_t start;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCKSTAT
+  contended = lock->holder != NULL;
+  start = cpu_cycles ();
+#endif
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate_priority (cur);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->locks_held, &lock->elem);
+#ifdef LOCKSTAT
+  lock->acquired = cpu_cycles ();
+  lockstat_acquired (lock->stat, contended, lock->acquired - start);
+#endif
+  intr_set_level (old_level);
+}
+
+/* Passes DONOR's priority down the chain of lock holders that
+   DONOR is (transitively) waiting on, raising each one that runs
+   at a lower priority.  Stops early at the first holder that
+   already runs at least as high, or after DONATION_DEPTH_MAX
+   holders.  Interrupts must be off. */
+static void
+donate_priority (struct thread *donor)
+{
+  struct lock *lock = donor->waiting_lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder == NULL || holder->priority >= donor->priority)
+        break;
+      thread_update_priority (holder, donor->priority);
+      lock = holder->waiting_lock;
+    }
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +375,30 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->locks_held, &lock->elem);
+#ifdef LOCKSTAT
+      lock->acquired = cpu_cycles ();
+      lockstat_acquired (lock->stat, false, 0);
+#endif
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Drops any priority that was donated through LOCK, which may
+   cause the current thread to yield.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +406,23 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCKSTAT
+  lockstat_released (lock->stat, cpu_cycles () - lock->acquired);
+#endif
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    thread_refresh_priority (cur);
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,8 +441,23 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A has a
+   lower priority than the one waiting on B. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,14 +500,50 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting after TICKS timer
+   ticks.  Returns true if COND was signaled, false if the time
+   limit expired first.  Either way, LOCK is held again on
+   return. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks)
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
+  list_push_back (&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* A signal may have slipped in between the timeout and
+     reacquiring LOCK.  Otherwise we are still on COND's list,
+     and must take ourselves off it while holding LOCK. */
+  if (!signaled)
+    {
+      signaled = sema_try_down (&waiter.semaphore);
+      if (!signaled)
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +558,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +581,343 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW, a readers-writer lock.  Any number of threads
+   may hold RW for reading at once, but a thread holding it for
+   writing excludes all others.
+
+   Writers are preferred: once a writer is waiting, newly arriving
+   readers wait behind it, so a steady stream of readers cannot
+   starve writers.  To keep writers from starving readers in
+   turn, a writer that releases RW lets in every reader that was
+   waiting at that moment before the next writer.
+
+   While a thread holds RW for writing, threads waiting for RW
+   donate their priority to it, just as they would to the holder
+   of a lock.  (The 4.4BSD scheduler does not use priority
+   donation.)  Threads holding RW for reading receive no
+   donations, since they are not tracked individually. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->guard);
+  lock_init (&rw->write_lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  cond_init (&rw->upgrade_ok);
+  rw->writer = NULL;
+  rw->readers = 0;
+  rw->waiting_readers = 0;
+  rw->waiting_writers = 0;
+  rw->admitted_readers = 0;
+  rw->upgrading = false;
+}
+
+/* Returns true if a new reader may enter RW now.  RW's guard
+   must be held. */
+static bool
+rwlock_can_read (const struct rwlock *rw)
+{
+  return (rw->writer == NULL
+          && ((rw->waiting_writers == 0 && !rw->upgrading)
+              || rw->admitted_readers > 0));
+}
+
+/* Returns true if a writer may enter RW now.  RW's guard must be
+   held. */
+static bool
+rwlock_can_write (const struct rwlock *rw)
+{
+  return (rw->writer == NULL && rw->readers == 0
+          && rw->admitted_readers == 0 && !rw->upgrading);
+}
+
+/* Waits on COND, protected by RW's guard, for RW's state to
+   change.  If a writer holds RW, waits by blocking on the
+   writer's lock instead, which donates our priority to it. */
+static void
+rwlock_wait (struct rwlock *rw, struct condition *cond)
+{
+  if (rw->writer != NULL && !thread_mlfqs)
+    {
+      lock_release (&rw->guard);
+      lock_acquire (&rw->write_lock);
+      lock_release (&rw->write_lock);
+      lock_acquire (&rw->guard);
+    }
+  else
+    cond_wait (cond, &rw->guard);
+}
+
+/* Makes the current thread RW's writer.  RW's guard must be
+   held and rwlock_can_write() must be true, or the current
+   thread must be the upgrading reader. */
+static void
+rwlock_become_writer (struct rwlock *rw)
+{
+  rw->writer = thread_current ();
+  lock_acquire (&rw->write_lock);
+}
+
+/* Lets in every thread waiting to read RW, ahead of any waiting
+   writers.  RW's guard must be held. */
+static void
+rwlock_admit_readers (struct rwlock *rw)
+{
+  rw->admitted_readers = rw->waiting_readers;
+  cond_broadcast (&rw->readers_ok, &rw->guard);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it.  The current thread must not already hold
+   RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_write_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  rw->waiting_readers++;
+  while (!rwlock_can_read (rw))
+    rwlock_wait (rw, &rw->readers_ok);
+  rw->waiting_readers--;
+  if (rw->admitted_readers > 0)
+    rw->admitted_readers--;
+  rw->readers++;
+  lock_release (&rw->guard);
+}
+
+/* Tries to acquire RW for reading without sleeping.  Returns true
+   if successful, false if a writer holds RW or is waiting for
+   it. */
+bool
+rwlock_try_acquire_read (struct rwlock *rw)
+{
+  bool success;
+
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->guard);
+  success = (rw->writer == NULL && rw->waiting_writers == 0
+             && !rw->upgrading);
+  if (success)
+    rw->readers++;
+  lock_release (&rw->guard);
+  return success;
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->guard);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    {
+      if (rw->upgrading)
+        cond_signal (&rw->upgrade_ok, &rw->guard);
+      else if (rw->waiting_writers > 0)
+        cond_signal (&rw->writers_ok, &rw->guard);
+    }
+  lock_release (&rw->guard);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  The current thread must not already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_write_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  rw->waiting_writers++;
+  while (!rwlock_can_write (rw))
+    rwlock_wait (rw, &rw->writers_ok);
+  rw->waiting_writers--;
+  rwlock_become_writer (rw);
+  lock_release (&rw->guard);
+}
+
+/* Tries to acquire RW for writing without sleeping.  Returns
+   true if successful, false if any other thread holds RW. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw)
+{
+  bool success;
+
+  ASSERT (rw != NULL);
+  ASSERT (!rwlock_write_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  success = rwlock_can_write (rw);
+  if (success)
+    rwlock_become_writer (rw);
+  lock_release (&rw->guard);
+  return success;
+}
+
+/* Releases RW, which the current thread holds for writing.
+   Readers that were waiting go next, then the next writer. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_write_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  rw->writer = NULL;
+  lock_release (&rw->write_lock);
+  if (rw->waiting_readers > 0)
+    rwlock_admit_readers (rw);
+  else if (rw->waiting_writers > 0)
+    cond_signal (&rw->writers_ok, &rw->guard);
+  lock_release (&rw->guard);
+}
+
+/* Converts the current thread's read access to RW into write
+   access, sleeping until the other readers are gone.  Neither
+   waiting writers nor newly arriving readers get in first.
+
+   Only one reader can wait to upgrade at a time, since two would
+   wait for each other forever.  If another reader is already
+   upgrading, returns false at once and the current thread still
+   holds RW for reading; it should release RW and then acquire it
+   for writing.  Otherwise returns true. */
+bool
+rwlock_upgrade (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->guard);
+  ASSERT (rw->readers > 0);
+  if (rw->upgrading)
+    {
+      lock_release (&rw->guard);
+      return false;
+    }
+
+  rw->upgrading = true;
+  rw->readers--;
+  while (rw->readers > 0 || rw->admitted_readers > 0)
+    cond_wait (&rw->upgrade_ok, &rw->guard);
+  rw->upgrading = false;
+  rwlock_become_writer (rw);
+  lock_release (&rw->guard);
+  return true;
+}
+
+/* Converts the current thread's write access to RW into read
+   access, without letting any writer in between.  Readers that
+   were waiting are let in too. */
+void
+rwlock_downgrade (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_write_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  rw->writer = NULL;
+  lock_release (&rw->write_lock);
+  rw->readers++;
+  if (rw->waiting_readers > 0)
+    rwlock_admit_readers (rw);
+  lock_release (&rw->guard);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rwlock_write_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+
+/* State shared by rwlock_self_test() and its helper thread. */
+struct rwlock_test
+  {
+    struct rwlock rw;           /* Lock under test. */
+    struct semaphore go;        /* Starts the helper's next step. */
+    struct semaphore done;      /* Signals the end of a step. */
+    bool can_read;              /* Helper could acquire for reading? */
+    bool can_write;             /* Helper could acquire for writing? */
+  };
+
+static void rwlock_test_helper (void *);
+
+/* Self-test for readers-writer locks.  The main thread takes
+   the lock in each mode in turn, and after each change a helper
+   thread checks which modes it can still get. */
+void
+rwlock_self_test (void)
+{
+  struct rwlock_test test;
+
+  printf ("Testing readers-writer locks...");
+  rwlock_init (&test.rw);
+  sema_init (&test.go, 0);
+  sema_init (&test.done, 0);
+  thread_create ("rwlock-test", PRI_DEFAULT, rwlock_test_helper, &test);
+
+  /* Readers share. */
+  rwlock_acquire_read (&test.rw);
+  sema_up (&test.go);
+  sema_down (&test.done);
+  ASSERT (test.can_read && !test.can_write);
+
+  /* A lone reader upgrades to exclusive access. */
+  if (!rwlock_upgrade (&test.rw))
+    PANIC ("upgrade failed");
+  sema_up (&test.go);
+  sema_down (&test.done);
+  ASSERT (!test.can_read && !test.can_write);
+
+  /* Downgrading lets readers back in. */
+  rwlock_downgrade (&test.rw);
+  sema_up (&test.go);
+  sema_down (&test.done);
+  ASSERT (test.can_read && !test.can_write);
+
+  /* Once released, the lock is free for writing. */
+  rwlock_release_read (&test.rw);
+  sema_up (&test.go);
+  sema_down (&test.done);
+  ASSERT (test.can_read && test.can_write);
+  printf ("done.\n");
+}
+
+/* Thread function used by rwlock_self_test(). */
+static void
+rwlock_test_helper (void *test_)
+{
+  struct rwlock_test *test = test_;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      sema_down (&test->go);
+      test->can_read = rwlock_try_acquire_read (&test->rw);
+      if (test->can_read)
+        rwlock_release_read (&test->rw);
+      test->can_write = rwlock_try_acquire_write (&test->rw);
+      if (test->can_write)
+        rwlock_release_write (&test->rw);
+      sema_up (&test->done);
+    }
+}
@@ -3,6 +3,9 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct lockstat_class;
 
 /* A counting semaphore. */
 struct semaphore 
@@ -13,6 +16,7 @@ struct semaphore
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
@@ -20,11 +24,22 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's locks_held list. */
+#ifdef LOCKSTAT
+    struct lockstat_class *stat; /* Contention statistics. */
+    uint64_t acquired;          /* Cycle count when acquired. */
+#endif
   };
 
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
+#ifdef LOCKSTAT
+/* Names each lock after the expression that initializes it, for
+   the contention report.  See threads/lockstat.h. */
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
+#endif
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
@@ -38,9 +53,38 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock guard;          /* Protects the members below. */
+    struct lock write_lock;     /* Held by the writer while it writes. */
+    struct condition readers_ok;        /* Readers may proceed. */
+    struct condition writers_ok;        /* A writer may proceed. */
+    struct condition upgrade_ok;        /* The upgrader may proceed. */
+    struct thread *writer;      /* Thread holding write access, or null. */
+    int readers;                /* Number of threads holding read access. */
+    int waiting_readers;        /* Number of threads waiting to read. */
+    int waiting_writers;        /* Number of threads waiting to write. */
+    int admitted_readers;       /* Waiting readers let in ahead of writers. */
+    bool upgrading;             /* A reader is waiting to upgrade. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_upgrade (struct rwlock *);
+void rwlock_downgrade (struct rwlock *);
+bool rwlock_write_held_by_current_thread (const struct rwlock *);
+void rwlock_self_test (void);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
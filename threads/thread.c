@@ -4,14 +4,21 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -21,23 +28,38 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level, and bit N of
+   ready_mask is set exactly when ready_queues[N] is nonempty, so
+   the highest ready priority is a single bit scan.  EDF threads
+   with budget left wait in ready_edf instead, ordered by
+   deadline, which is served first. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static struct list ready_edf;
+static int ready_count;         /* Total number of threads in the run queue. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+struct kmem_cache child_cache;
+
+/* Threads that have exited but whose pages have not been freed
+   yet, and the system work queue item that frees them.
+   thread_create() also frees them, so that a thread that creates
+   threads faster than the system queue runs cannot run out of
+   pages. */
+static struct list dead_list;
+static struct work reap_work;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -46,20 +68,36 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* The processor.  The idle thread and the statistics are kept
+   in it; see threads/cpu.h. */
+struct cpu boot_cpu;
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* 4.4BSD scheduler. */
+#define MLFQS_PRI_TICKS 4       /* Recompute priority every 4 ticks. */
+static fixed_t load_avg;        /* System load average. */
+
+/* Earliest-deadline-first class.  A thread that reserves BUDGET
+   ticks of CPU time every PERIOD ticks with thread_set_deadline()
+   runs ahead of all priority-scheduled threads, earliest
+   deadline first, until it has used up this period's budget.
+   Then it falls back to its normal priority until the budget is
+   refilled at its deadline, so an overrunning thread cannot
+   starve the others.  Admission control keeps the total reserved
+   share of the CPU at or below EDF_UTIL_MAX, under which EDF
+   meets every deadline of threads that stay within budget. */
+#define EDF_UTIL_MAX 900        /* Max reserved CPU share, in 1/1000. */
+static int edf_util;            /* Reserved CPU share, in 1/1000. */
+static long long edf_periods;   /* # of EDF periods ended. */
+static long long edf_misses;    /* # of those that missed their deadline. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -69,8 +107,26 @@ static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
+static void reap_threads (struct work *, void *aux);
+static void reap_dead_threads (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static bool is_idle (const struct thread *);
+static void ready_enqueue (struct thread *);
+static struct thread *ready_dequeue (void);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void mlfqs_tick (struct thread *cur);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static void mlfqs_update_recent_cpu (struct thread *, void *coeff);
+static bool edf_active (const struct thread *);
+static int edf_share (int64_t period, int64_t budget);
+static void edf_leave (struct thread *);
+static timer_event_func edf_deadline_expire;
+static bool deadline_less (const struct list_elem *, const struct list_elem *,
+                           void *aux);
+static bool ready_preempts (struct thread *cur);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -88,11 +144,21 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  list_init (&ready_edf);
+  ready_mask = 0;
+  ready_count = 0;
+  load_avg = 0;
   list_init (&all_list);
+  list_init (&dead_list);
+  kmem_cache_create (&child_cache, "child", sizeof (struct child), NULL);
+  work_init (&reap_work, reap_threads, NULL);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -114,7 +180,7 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to register itself with the CPU. */
   sema_down (&idle_started);
 }
 
@@ -124,19 +190,28 @@ void
 thread_tick (void) 
 {
   struct thread *t = thread_current ();
+  struct cpu *c = cpu_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == c->idle)
+    c->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    c->user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    c->kernel_ticks++;
+
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
+  /* Enforce the EDF budget.  Once it runs out, the thread goes
+     back on the run queue at its normal priority. */
+  if (edf_active (t) && --t->edf_runtime == 0)
+    intr_yield_on_return ();
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++c->time_slice >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
@@ -144,8 +219,13 @@ thread_tick (void)
 void
 thread_print_stats (void) 
 {
+  struct cpu *c = cpu_current ();
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          c->idle_ticks, c->kernel_ticks, c->user_ticks);
+  if (edf_periods > 0)
+    printf ("Thread: %lld of %lld EDF deadlines missed\n",
+            edf_misses, edf_periods);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -160,9 +240,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If PRIORITY is higher than the running thread's, the new
+   thread preempts it right away. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -175,6 +254,10 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
 
+  /* Free the pages of threads that have exited, in case the
+     system work queue has not had a chance to run. */
+  reap_dead_threads ();
+
   /* Allocate thread. */
   t = palloc_get_page (PAL_ZERO);
   if (t == NULL)
@@ -202,7 +285,7 @@ thread_create (const char *name, int priority,
   /* Set child and parent*/
   struct thread *cur = thread_current();
   t->parent = cur;
-  struct child *child_node = malloc(sizeof(struct child));
+  struct child *child_node = kmem_cache_alloc (&child_cache);
   list_push_back(&cur->children, &child_node->elem);
   child_node->tid = t->tid;
   child_node->exit_status = -1;
@@ -228,6 +311,8 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  /* For an EDF thread, blocking ends the current job. */
+  thread_current ()->edf_job_done = true;
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -236,10 +321,14 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted: immediately if interrupts were
+   on, or on return from the interrupt if called from an
+   interrupt handler.  If the caller had disabled interrupts
+   itself, it may expect that it can atomically unblock a thread
+   and update other data, so the running thread is not preempted;
+   such callers should call thread_preempt() once they turn
+   interrupts back on. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -249,9 +338,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_enqueue (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
 }
 
 /* Returns the name of the running thread. */
@@ -297,11 +389,13 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  edf_leave (thread_current ());
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -319,13 +413,41 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+  if (!is_idle (cur)) 
+    ready_enqueue (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread should run ahead of the
+   running thread: an EDF thread with an earlier deadline, or a
+   thread with a higher priority.  Within an interrupt handler, the yield
+   happens just before the interrupt returns.  Does nothing if
+   interrupts are off outside of an interrupt handler, since the
+   caller is then relying on not being preempted. */
+void
+thread_preempt (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool preempt;
+
+  old_level = intr_disable ();
+  if (is_idle (cur))
+    preempt = ready_count > 0;
+  else
+    preempt = ready_preempts (cur);
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (old_level == INTR_ON)
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -343,11 +465,77 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   effective priority stays raised while other threads donate a
+   higher one through a lock we hold.  Yields if that leaves a
+   ready thread with a higher priority. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The 4.4BSD scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Changes T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Does not preempt.
+   Interrupts must be off. */
+void
+thread_update_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_enqueue (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Recomputes T's effective priority from scratch: its base
+   priority, raised to that of the highest-priority thread
+   waiting on any lock T holds.  Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e, *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->locks_held); e != list_end (&t->locks_held);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+  thread_update_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -357,51 +545,267 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it is no longer the highest. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent;
 }
 
+/* 4.4BSD scheduler bookkeeping for one timer tick, with CUR
+   running.  Between the once-a-second updates only the running
+   thread's recent_cpu changes, so only its priority needs to be
+   recomputed.  The once-a-second update touches every thread,
+   since the load average feeds into all of them. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t now = timer_ticks ();
+
+  if (!is_idle (cur))
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_count + (!is_idle (cur) ? 1 : 0);
+      fixed_t twice_load;
+      fixed_t coeff;
+
+      /* load_avg = (59/60)*load_avg + (1/60)*ready_threads. */
+      load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                         fp_div_int (fp_from_int (ready_threads), 60));
+
+      /* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu
+                      + nice, with the coefficient computed once. */
+      twice_load = fp_mul_int (load_avg, 2);
+      coeff = fp_div (twice_load, fp_add_int (twice_load, 1));
+      thread_foreach (mlfqs_update_recent_cpu, &coeff);
+      thread_foreach (mlfqs_update_priority, NULL);
+      thread_preempt ();
+    }
+  else if (now % MLFQS_PRI_TICKS == 0 && !is_idle (cur))
+    {
+      mlfqs_update_priority (cur, NULL);
+      thread_preempt ();
+    }
+}
+
+/* Returns T's priority as computed from its recent_cpu and nice
+   values: PRI_MAX - recent_cpu/4 - nice*2, clamped to the valid
+   range. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int (fp_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* Recomputes T's priority with mlfqs_priority(), moving T to its
+   new run queue if it is ready.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  if (is_idle (t))
+    return;
+
+  t->base_priority = mlfqs_priority (t);
+  thread_update_priority (t, t->base_priority);
+}
+
+/* Decays T's recent_cpu by the load-dependent coefficient
+   *COEFF_ and adds its nice value.  Interrupts must be off. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *coeff_)
+{
+  fixed_t *coeff = coeff_;
+
+  if (is_idle (t))
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*coeff, t->recent_cpu), t->nice);
+}
+
+/* Makes the running thread an EDF thread that needs BUDGET
+   ticks of CPU time in every period of PERIOD ticks, starting
+   now, with each period's work due by the end of the period.  A
+   thread that is still runnable at a deadline, that is, has not
+   blocked since the period began, counts as having missed it.
+   A PERIOD of 0 returns the thread to normal scheduling.
+
+   Returns false, leaving the thread unchanged, if admitting the
+   reservation would overcommit the CPU. */
+bool
+thread_set_deadline (int64_t period, int64_t budget)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int share;
+
+  ASSERT (period >= 0);
+  ASSERT (period == 0 || (budget > 0 && budget <= period));
+
+  old_level = intr_disable ();
+  share = period != 0 ? edf_share (period, budget) : 0;
+  if (edf_util - edf_share (cur->edf_period, cur->edf_budget) + share
+      > EDF_UTIL_MAX)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+
+  edf_leave (cur);
+  if (period != 0)
+    {
+      cur->edf_period = period;
+      cur->edf_budget = cur->edf_runtime = budget;
+      cur->edf_deadline = timer_ticks () + period;
+      cur->edf_job_done = false;
+      edf_util += share;
+      timer_event_add_periodic (&cur->edf_timer, period);
+    }
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return true;
+}
+
+/* Returns the number of EDF deadlines missed so far, by all
+   threads. */
+long long
+thread_get_deadline_misses (void)
+{
+  enum intr_level old_level = intr_disable ();
+  long long misses = edf_misses;
+  intr_set_level (old_level);
+  return misses;
+}
+
+/* Returns true if T is an EDF thread with budget left, which
+   puts it ahead of all priority-scheduled threads. */
+static bool
+edf_active (const struct thread *t)
+{
+  return t->edf_period != 0 && t->edf_runtime > 0;
+}
+
+/* Returns the share of the CPU, in 1/1000, that BUDGET ticks out
+   of every PERIOD ticks amount to, rounded up, or 0 if PERIOD is
+   0. */
+static int
+edf_share (int64_t period, int64_t budget)
+{
+  return period != 0 ? DIV_ROUND_UP (budget * 1000, period) : 0;
+}
+
+/* Returns T to normal scheduling and releases its reservation,
+   if it had one.  T must not be ready.  Interrupts must be off. */
+static void
+edf_leave (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status != THREAD_READY);
+
+  if (t->edf_period == 0)
+    return;
+  timer_event_cancel (&t->edf_timer);
+  edf_util -= edf_share (t->edf_period, t->edf_budget);
+  t->edf_period = t->edf_budget = t->edf_runtime = 0;
+}
+
+/* Timer event callback for EDF thread T_ at each of its
+   deadlines: records whether T_ finished the period's work in
+   time, then starts the next period with a full budget. */
+static void
+edf_deadline_expire (struct timer_event *ev UNUSED, void *t_)
+{
+  struct thread *t = t_;
+  bool ready = t->status == THREAD_READY;
+
+  edf_periods++;
+  if (!t->edf_job_done)
+    edf_misses++;
+
+  /* Refilling the budget may move T to the EDF list. */
+  if (ready)
+    ready_remove (t);
+  t->edf_deadline += t->edf_period;
+  t->edf_runtime = t->edf_budget;
+  t->edf_job_done = t->status == THREAD_BLOCKED;
+  if (ready)
+    ready_enqueue (t);
+
+  thread_preempt ();
+}
+
+/* Returns true if thread A's deadline is earlier than B's.
+   Threads with equal deadlines keep their insertion order. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->edf_deadline < b->edf_deadline;
+}
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it registers itself as the CPU's idle thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never appears in the
+   run queue.  It is returned by next_thread_to_run() as a
+   special case when the run queue is empty. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  cpu_current ()->idle = thread_current ();
   sema_up (idle_started);
 
   for (;;) 
@@ -410,6 +814,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing to run: stop the periodic timer until the next
+         tick that has work to do. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -473,9 +881,29 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks_held);
+  t->waiting_lock = NULL;
+  timer_event_init (&t->edf_timer, edf_deadline_expire, t);
   t->magic = THREAD_MAGIC;
 
+  /* Under the 4.4BSD scheduler, a new thread inherits its
+     parent's nice and recent_cpu, and its priority follows from
+     those instead of PRIORITY. */
+  if (t != initial_thread)
+    {
+      struct thread *parent = running_thread ();
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+    }
+  else
+    {
+      t->nice = NICE_DEFAULT;
+      t->recent_cpu = 0;
+    }
+  if (thread_mlfqs)
+    t->priority = t->base_priority = mlfqs_priority (t);
+
   /* wait*/
   sema_init(&t->wait_sema, 0);
   t->wait_thread = -1;
@@ -516,14 +944,106 @@ alloc_frame (struct thread *t, size_t size)
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  if (ready_count == 0)
+    return cpu_current ()->idle;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return ready_dequeue ();
+}
+
+/* Returns true if T is the CPU's idle thread. */
+static bool
+is_idle (const struct thread *t)
+{
+  return t == cpu_current ()->idle;
+}
+
+/* Appends T to the run queue for its priority, or, for an EDF
+   thread with budget left, to the EDF list.  Interrupts must be
+   off. */
+static void
+ready_enqueue (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  if (edf_active (t))
+    list_insert_ordered (&ready_edf, &t->elem, deadline_less, NULL);
+  else
+    {
+      list_push_back (&ready_queues[t->priority], &t->elem);
+      ready_mask |= (uint64_t) 1 << t->priority;
+    }
+  ready_count++;
+}
+
+/* Removes and returns the EDF thread with the earliest deadline,
+   or if there is none, the first thread of the highest-priority
+   nonempty run queue.  The run queue must not be empty and
+   interrupts must be off. */
+static struct thread *
+ready_dequeue (void)
+{
+  int pri = ready_max_priority ();
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&ready_edf))
+    t = list_entry (list_pop_front (&ready_edf), struct thread, elem);
+  else
+    {
+      ASSERT (pri >= PRI_MIN);
+      t = list_entry (list_pop_front (&ready_queues[pri]),
+                      struct thread, elem);
+      if (list_empty (&ready_queues[pri]))
+        ready_mask &= ~((uint64_t) 1 << pri);
+    }
+  ready_count--;
+  return t;
+}
+
+/* Removes ready thread T from its run queue.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (!edf_active (t) && list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_count--;
+}
+
+/* Returns the highest priority among ready threads, or -1 if
+   no thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  if (ready_mask == 0)
+    return -1;
+  return 63 - __builtin_clzll (ready_mask);
+}
+
+/* Returns true if a ready thread should run ahead of CUR, which
+   is running.  Interrupts must be off. */
+static bool
+ready_preempts (struct thread *cur)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&ready_edf))
+    {
+      struct thread *t = list_entry (list_front (&ready_edf),
+                                     struct thread, elem);
+      return !edf_active (cur) || t->edf_deadline < cur->edf_deadline;
+    }
+  return !edf_active (cur) && ready_max_priority () > cur->priority;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -551,14 +1071,20 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  /* Pairs with the TRACE_SWITCH_OUT in schedule(), which is
+     recorded only when the running thread actually changes.
+     switch_entry() always passes a non-null PREV. */
+  if (prev != NULL)
+    trace (TRACE_SWITCH_IN, cur->tid, prev->tid);
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cpu_current ()->time_slice = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
+  fpu_switch ();
 
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
@@ -567,8 +1093,40 @@ thread_schedule_tail (struct thread *prev)
      palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
+      /* Freeing the page takes the page allocator's lock, which
+         has no business in the middle of a context switch, so
+         hand it off to the system work queue. */
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      list_push_back (&dead_list, &prev->elem);
+      work_queue_submit (&system_wq, &reap_work);
+    }
+}
+
+/* Frees the pages of the threads on dead_list.  Runs in a
+   system work queue worker. */
+static void
+reap_threads (struct work *w UNUSED, void *aux UNUSED)
+{
+  reap_dead_threads ();
+}
+
+/* Frees the pages of the threads on dead_list. */
+static void
+reap_dead_threads (void)
+{
+  ASSERT (!intr_context ());
+
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct thread *t = (list_empty (&dead_list) ? NULL
+                          : list_entry (list_pop_front (&dead_list),
+                                        struct thread, elem));
+      intr_set_level (old_level);
+
+      if (t == NULL)
+        break;
+      palloc_free_page (t);
     }
 }
 
@@ -591,7 +1149,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace (TRACE_SWITCH_OUT, cur->tid, cur->status);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -4,6 +4,8 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/synch.h"
 
 
@@ -26,6 +28,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the 4.4BSD scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -78,10 +85,11 @@ typedef int tid_t;
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c), or in the sleep list
+   (devices/timer.c).  It can be used these ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a blocked thread is on a
+   semaphore wait list or the sleep list, and never both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -89,13 +97,36 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
     struct list_elem allelem;           /* List element for all threads list. */
 
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Shared between thread.c and synch.c, for priority donation. */
+    struct list locks_held;             /* Locks this thread holds. */
+    struct lock *waiting_lock;          /* Lock this thread waits for. */
+
+    /* Owned by thread.c, for the 4.4BSD scheduler. */
+    int nice;                           /* Niceness, NICE_MIN..NICE_MAX. */
+    fixed_t recent_cpu;                 /* Recent CPU time received. */
+
+    /* Owned by thread.c, for the EDF scheduling class. */
+    int64_t edf_period;                 /* Period in ticks, 0 if not EDF. */
+    int64_t edf_budget;                 /* CPU ticks reserved per period. */
+    int64_t edf_runtime;                /* Budget left in this period. */
+    int64_t edf_deadline;               /* End of this period, in ticks. */
+    bool edf_job_done;                  /* Blocked since the period began? */
+    struct timer_event edf_timer;       /* Fires at each deadline. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at, if sleeping. */
+
+    /* Owned by threads/fpu.c. */
+    struct fpu_state *fpu;              /* FXSAVE area, null until FPU used. */
+
     /*waiting semaphore*/
     struct semaphore wait_sema;
     tid_t wait_thread;
@@ -128,6 +159,10 @@ struct thread
     unsigned magic;                     /* Detects stack overflow. */
   };
 
+/* Allocates struct child. */
+struct kmem_cache;
+extern struct kmem_cache child_cache;
+
 struct child {
 	tid_t tid;
 	struct list_elem elem;
@@ -165,6 +200,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -172,6 +208,11 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_update_priority (struct thread *, int priority);
+void thread_refresh_priority (struct thread *);
+
+bool thread_set_deadline (int64_t period, int64_t budget);
+long long thread_get_deadline_misses (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
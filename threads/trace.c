@@ -0,0 +1,89 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Number of events the ring buffer holds.  A power of 2, so
+   that the head index can simply wrap around. */
+#define TRACE_EVENTS 1024
+
+/* Set by the "-trace" command-line option. */
+bool trace_enabled;
+
+/* Ring buffer. */
+static struct trace_event *events;  /* TRACE_EVENTS events. */
+static uint32_t head;               /* Total number of events recorded. */
+
+/* Time-stamp counter and timer ticks when tracing started, to
+   work out the TSC's frequency for the decoder. */
+static uint64_t start_time;
+static int64_t start_ticks;
+
+/* Allocates the ring buffer, if tracing is enabled.  Must be
+   called before interrupts are turned on. */
+void
+trace_init (void)
+{
+  size_t pages = DIV_ROUND_UP (TRACE_EVENTS * sizeof (struct trace_event),
+                               PGSIZE);
+
+  if (!trace_enabled)
+    return;
+
+  events = palloc_get_multiple (PAL_ASSERT, pages);
+  start_time = cpu_cycles ();
+  start_ticks = timer_ticks ();
+}
+
+/* Records an event of the given TYPE for thread TID, with
+   type-specific argument ARG, in the ring buffer, overwriting
+   the oldest event if the buffer is full. */
+void
+trace_record (enum trace_type type, int tid, uint32_t arg)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (events != NULL)
+    {
+      struct trace_event *e = &events[head++ % TRACE_EVENTS];
+      e->time = cpu_cycles ();
+      e->arg = arg;
+      e->tid = tid;
+      e->type = type;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints the contents of the ring buffer, oldest event first, in the format that utils/pintos-trace reads.  Tracing
+   stops, so that a dump taken on panic is not repeated at the
+   shutdown that follows. */
+void
+trace_dump (void)
+{
+  uint64_t cycles_per_sec = 0;
+  int64_t ticks;
+  uint32_t n;
+
+  if (!trace_enabled)
+    return;
+  trace_enabled = false;
+
+  ticks = timer_ticks () - start_ticks;
+  if (ticks > 0)
+    cycles_per_sec = (cpu_cycles () - start_time) / ticks * TIMER_FREQ;
+
+  printf ("TRACE: begin %llu\n", (unsigned long long) cycles_per_sec);
+  if (events != NULL)
+    for (n = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0; n != head; n++)
+      {
+        struct trace_event *e = &events[n % TRACE_EVENTS];
+        printf ("TRACE: %llx %u %u %x\n", (unsigned long long) e->time,
+                e->type, e->tid, e->arg);
+      }
+  printf ("TRACE: end\n");
+}
@@ -0,0 +1,57 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Event tracing.
+
+   With the kernel command-line option "-trace", the scheduler,
+   the interrupt handler and the system call handler record what
+   they do in a ring buffer, which holds the most recent
+   TRACE_EVENTS events.  The buffers are dumped to the console,
+   and thus to the serial port, at shutdown or on a kernel panic.
+   utils/pintos-trace turns a dump into Chrome trace JSON, for
+   viewing in chrome://tracing or Perfetto.
+
+   Events are recorded with interrupts off, so recording takes no
+   locks. */
+
+/* Event types.  utils/pintos-trace knows these values. */
+enum trace_type
+  {
+    TRACE_SWITCH_OUT,           /* Thread stops running; ARG = status. */
+    TRACE_SWITCH_IN,            /* Thread starts running; ARG = prev tid. */
+    TRACE_INTR_ENTER,           /* Interrupt entry; ARG = vector. */
+    TRACE_INTR_EXIT,            /* Interrupt exit; ARG = vector. */
+    TRACE_SYSCALL_ENTER,        /* System call entry; ARG = number. */
+    TRACE_SYSCALL_EXIT          /* System call exit; ARG = number. */
+  };
+
+/* A recorded event, 16 bytes. */
+struct trace_event
+  {
+    uint64_t time;              /* Time-stamp counter. */
+    uint32_t arg;               /* Type-specific argument. */
+    uint16_t tid;               /* Thread concerned. */
+    uint8_t type;               /* One of enum trace_type. */
+  };
+
+extern bool trace_enabled;
+
+void trace_init (void);
+void trace_record (enum trace_type, int tid, uint32_t arg);
+void trace_dump (void);
+
+/* Records an event of the given TYPE for thread TID, if tracing
+   is enabled.  A macro, so that when tracing is off the
+   arguments are not even evaluated. */
+#define trace(TYPE, TID, ARG)                   \
+        do                                      \
+          {                                     \
+            if (trace_enabled)                  \
+              trace_record (TYPE, TID, ARG);    \
+          }                                     \
+        while (0)
+
+#endif /* threads/trace.h */
@@ -0,0 +1,234 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Number of workers in the system queue. */
+#define SYSTEM_WORKERS 1
+
+struct work_queue system_wq;
+
+/* All work queues, for statistics. */
+static struct list queues = LIST_INITIALIZER (queues);
+
+static void worker (void *wq_);
+static void submit_delayed (struct timer_event *, void *work_);
+
+/* Creates the system work queue.  Must be called after
+   thread_start() and before any thread exits, because dying
+   threads are reaped from the system queue. */
+void
+work_queue_init (void)
+{
+  work_queue_create (&system_wq, "system", SYSTEM_WORKERS, PRI_DEFAULT);
+}
+
+/* Initializes WQ as a work queue named NAME, served by WORKERS
+   kernel threads at the given PRIORITY. */
+void
+work_queue_create (struct work_queue *wq, const char *name,
+                   int workers, int priority)
+{
+  int i;
+
+  ASSERT (wq != NULL);
+  ASSERT (workers > 0);
+
+  wq->name = name;
+  list_init (&wq->items);
+  sema_init (&wq->ready, 0);
+  wq->workers = workers;
+  wq->completed = 0;
+  wq->batches = 0;
+  list_push_back (&queues, &wq->elem);
+
+  for (i = 0; i < workers; i++)
+    {
+      char thread_name[16];
+      snprintf (thread_name, sizeof thread_name, "%s/%d", name, i);
+      if (thread_create (thread_name, priority, worker, wq) == TID_ERROR)
+        PANIC ("%s: cannot create worker thread", name);
+    }
+}
+
+/* Initializes W to call FUNC with argument AUX when it runs. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->wq = NULL;
+  w->pending = false;
+  timer_event_init (&w->timer, submit_delayed, w);
+}
+
+/* Queues W to run in one of WQ's workers.  Returns true if W was
+   queued, false if it was already pending.  May be called from
+   an interrupt handler. */
+bool
+work_queue_submit (struct work_queue *wq, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (!w->pending)
+    {
+      /* Only the first item of a batch needs to wake a worker;
+         later ones are picked up along with it. */
+      bool was_empty = list_empty (&wq->items);
+      w->pending = true;
+      list_push_back (&wq->items, &w->elem);
+      if (was_empty)
+        sema_up (&wq->ready);
+      queued = true;
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* Queues W to run in one of WQ's workers once TICKS timer ticks
+   have passed.  A pending delay is restarted.  May be called
+   from an interrupt handler. */
+void
+work_queue_submit_delayed (struct work_queue *wq, struct work *w,
+                           int64_t ticks)
+{
+  enum intr_level old_level;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  if (ticks <= 0)
+    {
+      work_queue_submit (wq, w);
+      return;
+    }
+
+  old_level = intr_disable ();
+  w->wq = wq;
+  timer_event_cancel (&w->timer);
+  timer_event_add (&w->timer, ticks);
+  intr_set_level (old_level);
+}
+
+/* Timer callback for work_queue_submit_delayed(). */
+static void
+submit_delayed (struct timer_event *e UNUSED, void *work_)
+{
+  struct work *w = work_;
+  work_queue_submit (w->wq, w);
+}
+
+/* Cancels W if it is waiting for its delay to pass or for a
+   worker to run it.  Returns true if W was cancelled, false if
+   it was not pending.  Does not wait for a running W to
+   finish. */
+bool
+work_cancel (struct work *w)
+{
+  enum intr_level old_level;
+  bool cancelled;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  cancelled = timer_event_cancel (&w->timer);
+  if (w->pending)
+    {
+      list_remove (&w->elem);
+      w->pending = false;
+      cancelled = true;
+    }
+  intr_set_level (old_level);
+
+  return cancelled;
+}
+
+/* Returns true if W is queued or waiting for its delay to
+   pass. */
+bool
+work_pending (const struct work *w)
+{
+  return w->pending || timer_event_pending (&w->timer);
+}
+
+/* Prints statistics for each work queue. */
+void
+work_queue_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&queues); e != list_end (&queues); e = list_next (e))
+    {
+      struct work_queue *wq = list_entry (e, struct work_queue, elem);
+      printf ("Workqueue %s: %lld items run in %lld batches\n",
+              wq->name, wq->completed, wq->batches);
+    }
+}
+
+/* Worker thread for work queue WQ_.  Repeatedly dequeues a batch
+   of items and runs them. */
+static void
+worker (void *wq_)
+{
+  struct work_queue *wq = wq_;
+
+  for (;;)
+    {
+      struct list batch;
+      enum intr_level old_level;
+      int n;
+
+      sema_down (&wq->ready);
+
+      old_level = intr_disable ();
+      list_init (&batch);
+      for (n = 0; n < WORK_BATCH && !list_empty (&wq->items); n++)
+        {
+          struct list_elem *e = list_pop_front (&wq->items);
+          list_push_back (&batch, e);
+        }
+
+      /* Leave any remainder to another worker. */
+      if (!list_empty (&wq->items))
+        sema_up (&wq->ready);
+      if (n > 0)
+        wq->batches++;
+      intr_set_level (old_level);
+
+      /* Items stay pending until they leave the batch, so that
+         resubmitting one that has not run yet does nothing.  An
+         item may free its own memory or be resubmitted while it
+         runs, so read everything we need from it first. */
+      for (;;)
+        {
+          struct work *w;
+          work_func *func;
+          void *aux;
+
+          old_level = intr_disable ();
+          if (list_empty (&batch))
+            {
+              intr_set_level (old_level);
+              break;
+            }
+          w = list_entry (list_pop_front (&batch), struct work, elem);
+          w->pending = false;
+          func = w->func;
+          aux = w->aux;
+          wq->completed++;
+          intr_set_level (old_level);
+
+          func (w, aux);
+        }
+    }
+}
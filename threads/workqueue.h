@@ -0,0 +1,66 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+/* Work queues.
+
+   A work queue runs deferred work in a pool of kernel threads,
+   for chores that must not run in interrupt context or that
+   would otherwise delay a latency-sensitive caller.  Work may be
+   submitted from any context, including interrupt handlers, and
+   either immediately or after a delay measured in timer ticks.
+
+   A work item is queued at most once: submitting an item that is
+   already pending does nothing, so a chore that is requested
+   many times before it runs runs only once.  Workers dequeue
+   items in batches of up to WORK_BATCH, so that a burst of
+   submissions costs one wakeup rather than one per item.  An
+   item is no longer pending by the time its function runs, so
+   the function may resubmit it. */
+struct work;
+typedef void work_func (struct work *, void *aux);
+
+struct work
+  {
+    struct list_elem elem;      /* Element in work_queue's `items'. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Function argument. */
+    struct work_queue *wq;      /* Queue for delayed submission. */
+    bool pending;               /* True while queued. */
+    struct timer_event timer;   /* Delays submission. */
+  };
+
+/* Maximum number of items a worker dequeues at once. */
+#define WORK_BATCH 16
+
+struct work_queue
+  {
+    const char *name;           /* Name, for debugging. */
+    struct list_elem elem;      /* Element in the list of queues. */
+    struct list items;          /* Pending work, oldest first. */
+    struct semaphore ready;     /* Upped when ITEMS becomes nonempty. */
+    int workers;                /* # of worker threads. */
+    long long completed;        /* # of items run. */
+    long long batches;          /* # of batches dequeued. */
+  };
+
+/* General-purpose queue for short kernel chores. */
+extern struct work_queue system_wq;
+
+void work_queue_init (void);
+void work_queue_create (struct work_queue *, const char *name,
+                        int workers, int priority);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue_submit (struct work_queue *, struct work *);
+void work_queue_submit_delayed (struct work_queue *, struct work *,
+                                int64_t ticks);
+bool work_cancel (struct work *);
+bool work_pending (const struct work *);
+void work_queue_print_stats (void);
+
+#endif /* threads/workqueue.h */
@@ -2,14 +2,19 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of FPU state switches. */
+static long long fpu_switch_cnt;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -45,7 +50,7 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
+  intr_register_int (7, 0, INTR_ON, device_not_available,
                      "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
@@ -65,6 +70,8 @@ void
 exception_print_stats (void) 
 {
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  if (fpu_switch_cnt > 0)
+    printf ("Exception: %lld FPU state switches\n", fpu_switch_cnt);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -159,3 +166,18 @@ page_fault (struct intr_frame *f)
   kill (f);
 }
 
+/* #NM handler.  A user process executed an FPU or SSE instruction
+   while CR0.TS was set, because another thread's state, or none,
+   is loaded in the FPU.  Switch the FPU to this thread and retry
+   the instruction.  Kills the process if the FPU is disabled or
+   its state cannot be allocated. */
+static void
+device_not_available (struct intr_frame *f)
+{
+  if (f->cs != SEL_UCSEG || !fpu_claim ())
+    {
+      kill (f);
+      return;
+    }
+  fpu_switch_cnt++;
+}
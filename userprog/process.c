@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -15,6 +16,7 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
@@ -131,7 +133,7 @@ process_wait (tid_t child_tid)
 
 	int status = child_node->exit_status;
 	list_remove(e);
-	free(child_node);
+	kmem_cache_free(&child_cache, child_node);
 	cur->wait_thread = -1;
 	return status;
 }
@@ -187,7 +189,7 @@ close_files(struct list* fd_table) {
 		file_close(fd->f);
 		lock_release(filesys_lock);
 		list_remove(e);
-		free(fd);
+		kmem_cache_free(&fd_cache, fd);
 	}
 }
 
@@ -10,13 +10,17 @@
 
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 
 #define MAX_ARGS 3
+struct kmem_cache fd_cache;
+
 static void syscall_handler (struct intr_frame *);
 void fetch_args (uint32_t* esp, uint32_t* args_, int num);
 void check_vaddr (const void* vaddr);
@@ -37,6 +41,7 @@ void close_(int fd_num);
 void
 syscall_init (void) 
 {
+  kmem_cache_create (&fd_cache, "fd", sizeof (struct fd), NULL);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -48,6 +53,7 @@ syscall_handler (struct intr_frame *f)
 	uint32_t syscall_num = *esp;
 	esp++;
 	uint32_t args[MAX_ARGS];
+	trace (TRACE_SYSCALL_ENTER, thread_tid (), syscall_num);
 	switch (syscall_num) {
 		case SYS_HALT:
 			shutdown_power_off();
@@ -104,6 +110,7 @@ syscall_handler (struct intr_frame *f)
 			printf("Unimplemented system call%d", syscall_num);
 			break;
 	}
+	trace (TRACE_SYSCALL_EXIT, thread_tid (), syscall_num);
 }
 
 void
@@ -150,7 +157,7 @@ open_(const char *file) {
 		return -1;
 	}
 	struct thread *cur = thread_current();
-	struct fd *fd = malloc(sizeof(struct fd));
+	struct fd *fd = kmem_cache_alloc(&fd_cache);
 	fd->f = f;
 	fd->fd_num = cur->fd_count;
 	cur->fd_count++;
@@ -227,7 +234,7 @@ close_ (int fd_num) {
 	file_close(fd->f);
 	lock_release(filesys_lock);
 	list_remove(&fd->elem);
-	free(fd);
+	kmem_cache_free(&fd_cache, fd);
 }
 
 struct fd*
@@ -3,4 +3,8 @@
 
 void syscall_init (void);
 
+/* Allocates struct fd. */
+struct kmem_cache;
+extern struct kmem_cache fd_cache;
+
 #endif /* userprog/syscall.h */